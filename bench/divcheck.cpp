@@ -0,0 +1,126 @@
+/*
+  divcheck - exactness check for division by literals
+
+  For each divisor d, takes divMagic(d) and checks divConst(n, magic,
+  shift) == n / d over the dividends where a multiply-high is most
+  likely to be off by one: INT64_MIN, INT64_MAX and their neighbours,
+  0, +-1, the multiples of d around +-1, +-d and the largest multiples
+  of d, each +-1, plus random ones. Divisors are 2..DIVCHECK_SMALL,
+  every power of two and its neighbours, INT64_MAX and its neighbours,
+  powers of 10 and random divisors of every bit length. Also checks that
+  divMagic() refuses d < 2. `make div-test` runs it.
+
+  Usage: divcheck [--random=N]
+    --random  random divisors per bit length, and random dividends per
+              divisor (default 64)
+*/
+
+#include "../compiler.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+#define DIVCHECK_SMALL 5000  // every divisor up to this
+
+static uint64_t pairs = 0;
+static std::mt19937_64 rng(1);
+static int randomCount = 64;
+
+/*****************************************************/
+/* check - n / d by divConst against the hardware, exit on a mismatch */
+static void check(int64_t n, int64_t d, int64_t magic, int shift) {
+    int64_t want = n / d, got = divConst(n, magic, shift);
+    pairs++;
+    if (got != want) {
+        printf("div-test: %" PRId64 " / %" PRId64 " = %" PRId64 ", divConst gives %" PRId64
+               " (magic %" PRId64 ", shift %d)\n", n, d, want, got, magic, shift);
+        exit(1);
+    }
+}
+
+/*****************************************************/
+/* checkDivisor - every edge dividend for d, both signs */
+static void checkDivisor(int64_t d) {
+    int64_t magic;
+    int shift;
+    if (!divMagic(d, magic, shift)) {
+        printf("div-test: divMagic(%" PRId64 ") failed\n", d);
+        exit(1);
+    }
+    int64_t top = INT64_MAX / d * d;  // largest multiple of d
+    const int64_t edges[] = {
+        INT64_MIN, INT64_MIN + 1, INT64_MAX, INT64_MAX - 1, 0, 1, -1,
+        d - 1, d, d + 1, 2 * (d / 2) - 1, top, top - 1, top - d, top - d + 1,
+    };
+    for (int64_t n : edges) {
+        check(n, d, magic, shift);
+        if (n != INT64_MIN) {
+            check(-n, d, magic, shift);
+        }
+    }
+    for (int i = 0; i < randomCount; i++) {
+        int64_t n = (int64_t)rng();
+        check(n, d, magic, shift);
+        int64_t k = n / d;  // a multiple of d near n, and its neighbours
+        check(k * d, d, magic, shift);
+        check(k * d + 1, d, magic, shift);
+        check(k * d - 1, d, magic, shift);
+    }
+}
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--random=", 9) == 0 && atoi(argv[i] + 9) > 0) {
+            randomCount = atoi(argv[i] + 9);
+        } else {
+            fprintf(stderr, "Usage: %s [--random=N]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    const int64_t refused[] = { 1, 0, -1, -2, -7, INT64_MIN };
+    for (int64_t d : refused) {
+        int64_t magic;
+        int shift;
+        if (divMagic(d, magic, shift)) {
+            printf("div-test: divMagic(%" PRId64 ") should refuse\n", d);
+            return 1;
+        }
+    }
+
+    uint64_t divisors = 0;
+    for (int64_t d = 2; d <= DIVCHECK_SMALL; d++, divisors++) {
+        checkDivisor(d);
+    }
+    for (int b = 1; b < 63; b++) {
+        int64_t p = (int64_t)1 << b;
+        for (int64_t d : { p - 1, p, p + 1 }) {
+            if (d > DIVCHECK_SMALL) {
+                checkDivisor(d);
+                divisors++;
+            }
+        }
+    }
+    for (int64_t d : { INT64_MAX, INT64_MAX - 1, INT64_MAX / 2, INT64_MAX / 3 }) {
+        checkDivisor(d);
+        divisors++;
+    }
+    for (int64_t d = 10000; d <= INT64_MAX / 10; d *= 10) {
+        checkDivisor(d);
+        divisors++;
+    }
+    for (int b = 2; b <= 63; b++) {
+        for (int i = 0; i < randomCount; i++) {
+            int64_t d = (int64_t)(rng() >> (64 - b));
+            if (d >= 2) {
+                checkDivisor(d);
+                divisors++;
+            }
+        }
+    }
+    printf("div-test: ok (%" PRIu64 " divisors, %" PRIu64 " pairs)\n", divisors, pairs);
+    return 0;
+}
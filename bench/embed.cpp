@@ -0,0 +1,132 @@
+/*
+  embed - example and check for embed.h
+
+  Embeds programs with EMBED_PROGRAM, so they are parsed and validated
+  while this file compiles, then runs one and prints each assigned
+  variable as `./main --eval` would. `make embed-test` compares the two
+  outputs for each program and reports the embedded evaluator's time
+  per run. Besides the sample, "chain" has '+'/'-' and '*'/'/' chains
+  of over a thousand terms and "nested" an expression whose tree is
+  over a thousand levels deep through nested parentheses, far past the
+  compiler's template depth.
+
+  Usage: embed [--program=sample|chain|nested] [--source] [--runs=N]
+    --program  the program to run (default sample)
+    --source   print the program's text instead
+    --runs     time N runs of the program (default 1000000)
+*/
+
+#include "../embed.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+EMBED_PROGRAM(Sample,
+    "~ embedded sample: every operator, wraparound and truncation\n"
+    "begin\n"
+    "  width = 640;\n"
+    "  height = 480;\n"
+    "  area = width * height;\n"
+    "  half_w = width / 2;\n"
+    "  aspect = (width * 1000) / height;\n"
+    "  neg = 0 - 7;\n"
+    "  q = neg / 2;            ~ truncates toward zero: -3\n"
+    "  r = neg - q * 2;\n"
+    "  big = 9223372036854775807 + 1;\n"
+    "  wrapped = big / (0 - 1);\n"
+    "  mix_1 = ((area - half_w) * (aspect + r)) / (q - 1);\n"
+    "  acc = mix_1 + acc * 31;\n"
+    "  unset_sum = nothing + 5;\n"
+    "end.\n");
+
+// EMBED_REPEAT10(s) - s ten times, for long program texts
+#define EMBED_REPEAT10(s) s s s s s s s s s s
+
+EMBED_PROGRAM(Chain,
+    "begin\n"
+    "  x = 3;\n"
+    "  sum = x" EMBED_REPEAT10(EMBED_REPEAT10(EMBED_REPEAT10(" + x - 1"))) ";\n"
+    "  prod = x" EMBED_REPEAT10(EMBED_REPEAT10(EMBED_REPEAT10(" * 7 / 7"))) " * x;\n"
+    "  wrap = 9223372036854775807" EMBED_REPEAT10(EMBED_REPEAT10(" + x * x")) ";\n"
+    "end.\n");
+
+// 100 levels of parentheses, each a chain of 11 terms: the tree is
+// about 1100 levels deep
+EMBED_PROGRAM(Nested,
+    "begin\n"
+    "  y = 5;\n"
+    "  deep = " EMBED_REPEAT10(EMBED_REPEAT10("(y - ")) "1"
+        EMBED_REPEAT10(EMBED_REPEAT10(" - y + 2 - y + 2 - y + 2 - y + 2 - y + 2)")) ";\n"
+    "  ratio = deep / y;\n"
+    "end.\n");
+
+// validated at compile time; a typo in the text fails the build
+static_assert(Embedded<Sample>::statements == 13, "statement count");
+static_assert(Embedded<Sample>::slot("mix_1") == 10, "symbols in order of first appearance");
+
+/*****************************************************/
+/* runEmbedded - run P once and print its variables, then time `runs` runs */
+template <class P>
+static int runEmbedded(long runs) {
+    int64_t vars[Embedded<P>::symbols] = {};
+    if (uint32_t failed = Embedded<P>::run(vars)) {
+        fprintf(stderr, "Runtime error: division by zero in statement %u\n", failed);
+        return 1;
+    }
+    bool assigned[Embedded<P>::symbols] = {};
+    for (uint32_t i = 0; i < Embedded<P>::statements; i++) {
+        assigned[Embedded<P>::ast.stmts[i].target] = true;
+    }
+    for (uint32_t s = 0; s < Embedded<P>::symbols; s++) {
+        if (assigned[s]) {
+            size_t len;
+            const char* name = Embedded<P>::name(s, len);
+            printf("%.*s = %lld\n", (int)len, name, (long long)vars[s]);
+        }
+    }
+
+    // the sample's acc feeds back into itself, so no two runs are alike
+    auto t0 = std::chrono::steady_clock::now();
+    for (long k = 0; k < runs; k++) {
+        Embedded<P>::run(vars);
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    uint64_t sum = 0;  // of every variable, so no run is dead code
+    for (uint32_t s = 0; s < Embedded<P>::symbols; s++) {
+        sum += (uint64_t)vars[s];
+    }
+    fprintf(stderr, "embedded eval: %.1f ns per run (%u statements, %ld runs, sum %lld)\n",
+            secs * 1e9 / runs, Embedded<P>::statements, runs, (long long)sum);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    long runs = 1000000;
+    const char* program = "sample";
+    bool source = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--source") == 0) {
+            source = true;
+        } else if (strncmp(argv[i], "--program=", 10) == 0) {
+            program = argv[i] + 10;
+        } else if (strncmp(argv[i], "--runs=", 7) == 0 && atol(argv[i] + 7) > 0) {
+            runs = atol(argv[i] + 7);
+        } else {
+            fprintf(stderr, "Usage: %s [--program=sample|chain|nested] [--source] [--runs=N]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    if (strcmp(program, "sample") == 0) {
+        return source ? fputs(Sample::text, stdout) < 0 : runEmbedded<Sample>(runs);
+    } else if (strcmp(program, "chain") == 0) {
+        return source ? fputs(Chain::text, stdout) < 0 : runEmbedded<Chain>(runs);
+    } else if (strcmp(program, "nested") == 0) {
+        return source ? fputs(Nested::text, stdout) < 0 : runEmbedded<Nested>(runs);
+    }
+    fprintf(stderr, "embed: no program named %s\n", program);
+    return 1;
+}
@@ -0,0 +1,307 @@
+/*
+  exactcheck - reference evaluator for --eval --exact
+
+  Reads a program and prints what `./main --eval --exact` should print
+  for it: the values of the assigned variables in order of first
+  appearance, or the division-by-zero error, with the same exit
+  status. Numbers are signed strings of decimal digits with their own
+  schoolbook arithmetic, and division is long division by repeated
+  subtraction, so nothing is shared with the BigInt code it checks.
+  The program must be free of syntax errors. `make exact-test`
+  compares the two on boundary cases and generated programs.
+
+  Usage: exactcheck <source_file>
+*/
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Dec - a signed decimal integer; digits little-endian, no leading 0s,
+// zero is empty and not negative
+struct Dec {
+    bool                 neg = false;
+    std::vector<uint8_t> d;
+};
+
+/*****************************************************/
+/* magCmp - compare magnitudes: -1, 0 or 1 */
+static int magCmp(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b) {
+    if (a.size() != b.size()) {
+        return a.size() < b.size() ? -1 : 1;
+    }
+    for (size_t i = a.size(); i-- > 0; ) {
+        if (a[i] != b[i]) {
+            return a[i] < b[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+static void trim(std::vector<uint8_t>& a) {
+    while (!a.empty() && a.back() == 0) {
+        a.pop_back();
+    }
+}
+
+static std::vector<uint8_t> magAdd(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b) {
+    std::vector<uint8_t> r;
+    int carry = 0;
+    for (size_t i = 0; i < a.size() || i < b.size() || carry; i++) {
+        int s = carry + (i < a.size() ? a[i] : 0) + (i < b.size() ? b[i] : 0);
+        r.push_back((uint8_t)(s % 10));
+        carry = s / 10;
+    }
+    return r;
+}
+
+/* magSub - a - b for a >= b */
+static std::vector<uint8_t> magSub(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b) {
+    std::vector<uint8_t> r;
+    int borrow = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        int s = a[i] - borrow - (i < b.size() ? b[i] : 0);
+        borrow = s < 0;
+        r.push_back((uint8_t)(s + 10 * borrow));
+    }
+    trim(r);
+    return r;
+}
+
+static Dec fix(Dec x) {
+    trim(x.d);
+    if (x.d.empty()) {
+        x.neg = false;
+    }
+    return x;
+}
+
+static Dec add(const Dec& x, const Dec& y) {
+    Dec r;
+    if (x.neg == y.neg) {
+        r.neg = x.neg;
+        r.d = magAdd(x.d, y.d);
+    } else if (magCmp(x.d, y.d) >= 0) {
+        r.neg = x.neg;
+        r.d = magSub(x.d, y.d);
+    } else {
+        r.neg = y.neg;
+        r.d = magSub(y.d, x.d);
+    }
+    return fix(r);
+}
+
+static Dec sub(const Dec& x, Dec y) {
+    y.neg = !y.neg;
+    return add(x, fix(y));
+}
+
+static Dec mul(const Dec& x, const Dec& y) {
+    Dec r;
+    std::vector<int> acc(x.d.size() + y.d.size() + 1, 0);
+    for (size_t i = 0; i < x.d.size(); i++) {
+        for (size_t j = 0; j < y.d.size(); j++) {
+            acc[i + j] += x.d[i] * y.d[j];
+            acc[i + j + 1] += acc[i + j] / 10;
+            acc[i + j] %= 10;
+        }
+    }
+    for (size_t i = 0; i + 1 < acc.size(); i++) {
+        acc[i + 1] += acc[i] / 10;
+        r.d.push_back((uint8_t)(acc[i] % 10));
+    }
+    r.d.push_back((uint8_t)acc.back());
+    r.neg = x.neg != y.neg;
+    return fix(r);
+}
+
+/* quot - x / y rounded toward zero, y nonzero */
+static Dec quot(const Dec& x, const Dec& y) {
+    Dec q;
+    std::vector<uint8_t> rem;
+    q.d.assign(x.d.size(), 0);
+    for (size_t i = x.d.size(); i-- > 0; ) {
+        rem.insert(rem.begin(), x.d[i]);  // rem = rem * 10 + digit
+        trim(rem);
+        while (magCmp(rem, y.d) >= 0) {
+            rem = magSub(rem, y.d);
+            q.d[i]++;
+        }
+    }
+    q.neg = x.neg != y.neg;
+    return fix(q);
+}
+
+static std::string text(const Dec& x) {
+    if (x.d.empty()) {
+        return "0";
+    }
+    std::string s = x.neg ? "-" : "";
+    for (size_t i = x.d.size(); i-- > 0; ) {
+        s += (char)('0' + x.d[i]);
+    }
+    return s;
+}
+
+// ---------- Parser ----------
+// the grammar of compiler.cpp, evaluating as it goes; statements run
+// in order, so values can be computed while parsing
+static std::string src;
+static size_t pos = 0;
+static std::vector<std::string> names;           // symbols, first appearance first
+static std::unordered_map<std::string, size_t> symIndex;
+static std::vector<Dec> vars;
+static std::vector<bool> assigned;
+static bool failed = false;  // this statement divided by zero
+
+static void syntax() {
+    fprintf(stderr, "exactcheck: syntax error at offset %zu\n", pos);
+    exit(2);
+}
+
+static void skip() {
+    for (;;) {
+        while (pos < src.size() && isspace((unsigned char)src[pos])) {
+            pos++;
+        }
+        if (pos < src.size() && src[pos] == '~') {
+            while (pos < src.size() && src[pos] != '\n') {
+                pos++;
+            }
+        } else {
+            return;
+        }
+    }
+}
+
+static std::string word() {
+    skip();
+    size_t start = pos;
+    while (pos < src.size() && (isalnum((unsigned char)src[pos]) || src[pos] == '_')) {
+        pos++;
+    }
+    return src.substr(start, pos - start);
+}
+
+static char peekChar() {
+    skip();
+    return pos < src.size() ? src[pos] : '\0';
+}
+
+static void expect(char c) {
+    if (peekChar() != c) {
+        syntax();
+    }
+    pos++;
+}
+
+static size_t symbol(const std::string& name) {
+    auto it = symIndex.find(name);
+    if (it != symIndex.end()) {
+        return it->second;
+    }
+    names.push_back(name);
+    vars.emplace_back();
+    assigned.push_back(false);
+    return symIndex[name] = names.size() - 1;
+}
+
+static Dec expr();
+
+static Dec factor() {
+    char c = peekChar();
+    if (c == '(') {
+        pos++;
+        Dec v = expr();
+        expect(')');
+        return v;
+    }
+    std::string w = word();
+    if (w.empty()) {
+        syntax();
+    }
+    if (isdigit((unsigned char)w[0])) {
+        Dec v;
+        for (size_t i = w.size(); i-- > 0; ) {
+            v.d.push_back((uint8_t)(w[i] - '0'));
+        }
+        return fix(v);
+    }
+    return vars[symbol(w)];
+}
+
+static Dec term() {
+    Dec v = factor();
+    for (char c; (c = peekChar()) == '*' || c == '/'; ) {
+        pos++;
+        Dec y = factor();
+        if (c == '*') {
+            v = mul(v, y);
+        } else if (y.d.empty()) {
+            failed = true;
+        } else {
+            v = quot(v, y);
+        }
+    }
+    return v;
+}
+
+static Dec expr() {
+    Dec v = term();
+    for (char c; (c = peekChar()) == '+' || c == '-'; ) {
+        pos++;
+        v = c == '+' ? add(v, term()) : sub(v, term());
+    }
+    return v;
+}
+
+int main(int argc, char** argv) {
+    FILE* f = argc == 2 ? fopen(argv[1], "rb") : NULL;
+    if (f == NULL) {
+        fprintf(stderr, "Usage: %s <source_file>\n", argv[0]);
+        return 2;
+    }
+    for (int c; (c = fgetc(f)) != EOF; ) {
+        src += (char)c;
+    }
+    fclose(f);
+
+    if (word() != "begin") {
+        syntax();
+    }
+    printf("Parsing completed successfully.\n");
+    for (size_t stmt = 1; ; stmt++) {
+        size_t save = pos;
+        std::string target = word();
+        if (target == "end") {
+            break;
+        }
+        if (target.empty()) {
+            pos = save;
+            syntax();
+        }
+        size_t t = symbol(target);
+        expect('=');
+        failed = false;
+        Dec v = expr();
+        expect(';');
+        if (failed) {
+            fflush(stdout);
+            fprintf(stderr, "Runtime error: division by zero in statement %zu (assignment to %s)\n",
+                    stmt, target.c_str());
+            return 1;
+        }
+        vars[t] = v;
+        assigned[t] = true;
+    }
+    expect('.');
+    for (size_t s = 0; s < names.size(); s++) {
+        if (assigned[s]) {
+            printf("%s = %s\n", names[s].c_str(), text(vars[s]).c_str());
+        }
+    }
+    return 0;
+}
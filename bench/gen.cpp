@@ -0,0 +1,241 @@
+/*
+  gen - synthetic program generator for benchmarking ./main
+
+  Emits a valid program in the style of tests/a1-a8:
+    ~ comment lines
+    begin
+      ident = expr;
+      ...
+    end.
+
+  Usage: gen [--statements=N] [--size=BYTES] [--depth=D] [--ident-len=L]
+             [--comments=P] [--underscores=P] [--literals=P] [--vars=N]
+             [--digits=D] [--terms=N] [--factors=N] [--safe-div] [--seed=S]
+    --statements   number of assignment statements (default 1000)
+    --size         stop once this many bytes are written (overrides --statements)
+    --depth        max '(' nesting in an expression (default 2)
+    --ident-len    average identifier length (default 5)
+    --comments     chance of a '~' comment line before each statement (default 0.05)
+    --underscores  chance of a '_' after each identifier character (default 0.1)
+    --literals     chance a factor is an integer literal (default 0.3)
+    --vars         draw identifiers from N names instead of fresh ones (default 0)
+    --digits       max digits in an integer literal (default 6)
+    --terms        max '+'/'-' operands in an expression (default 4)
+    --factors      max '*'/'/' operands in a term (default 2)
+    --safe-div     divide by nonzero literals only, so --eval never fails
+*/
+
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <string>
+#include <random>
+#include <algorithm>
+#include <vector>
+
+// ---------- Options ----------
+long long statements = 1000;
+long long sizeLimit  = 0;
+int       maxDepth   = 2;
+int       identLen   = 5;
+double    comments   = 0.05;
+double    underscores = 0.1;
+double    literals   = 0.3;
+int       vars       = 0;
+int       digits     = 6;
+int       terms      = 4;
+int       factors    = 2;
+bool      safeDiv    = false;
+unsigned long long seed = 1;
+
+// ---------- Output ----------
+std::string out;
+std::mt19937_64 rng;
+std::vector<std::string> names;     // --vars pool
+
+double chance() {
+    return std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+}
+
+int between(int lo, int hi) {
+    return std::uniform_int_distribution<int>(lo, hi)(rng);
+}
+
+void flush() {
+    fwrite(out.data(), 1, out.size(), stdout);
+    out.clear();
+}
+
+/*****************************************************/
+/* identifier - letter first, single '_' separators, never a keyword;
+   with --vars, one of a fixed pool of such names */
+void freshIdentifier();
+
+void identifier() {
+    if (vars > 0) {
+        out += names[between(0, vars - 1)];
+    } else {
+        freshIdentifier();
+    }
+}
+
+void freshIdentifier() {
+    static const char letters[] = "abcdefghijklmnopqrstuvwxyz";
+    static const char alnum[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+    size_t start = out.size();
+    int len = std::max(1, between(identLen / 2, identLen + identLen / 2));
+
+    out += letters[between(0, 25)];
+    for (int i = 1; i < len; i++) {
+        if (out.back() != '_' && chance() < underscores) {
+            out += '_';
+        } else {
+            out += alnum[between(0, 35)];
+        }
+    }
+
+    std::string word = out.substr(start);
+    if (word == "begin" || word == "end") {
+        out += 'x';
+    }
+}
+
+/*****************************************************/
+/* number - literal of 1 to --digits digits, like 5 or 45678 */
+void number() {
+    int len = between(1, digits);
+    out += (char)('1' + between(0, 8));
+    for (int i = 1; i < len; i++) {
+        out += (char)('0' + between(0, 9));
+    }
+}
+
+void expr(int depth);
+
+/*****************************************************/
+/* factor = identifier | number | "(", expr, ")" */
+void factor(int depth) {
+    if (depth < maxDepth && chance() < 0.15) {
+        out += '(';
+        expr(depth + 1);
+        out += ')';
+    } else if (chance() < literals) {
+        number();
+    } else {
+        identifier();
+    }
+}
+
+/*****************************************************/
+/* term = factor, { ("*" | "/"), factor } */
+void term(int depth) {
+    factor(depth);
+    int n = between(0, factors - 1);
+    for (int i = 0; i < n; i++) {
+        if (chance() < 0.5) {
+            out += " * ";
+            factor(depth);
+        } else {
+            out += " / ";
+            if (safeDiv) {
+                number();
+            } else {
+                factor(depth);
+            }
+        }
+    }
+}
+
+/*****************************************************/
+/* expr = term, { ("+" | "-"), term } */
+void expr(int depth) {
+    term(depth);
+    int n = between(0, terms - 1);
+    for (int i = 0; i < n; i++) {
+        out += chance() < 0.6 ? " + " : " - ";
+        term(depth);
+    }
+}
+
+/*****************************************************/
+/* parse --name=value options */
+bool option(const char* arg, const char* name, const char** value) {
+    size_t n = strlen(name);
+    if (strncmp(arg, name, n) == 0 && arg[n] == '=') {
+        *value = arg + n + 1;
+        return true;
+    }
+    return false;
+}
+
+int main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        const char* v;
+        if (option(argv[i], "--statements", &v)) {
+            statements = atoll(v);
+        } else if (option(argv[i], "--size", &v)) {
+            sizeLimit = atoll(v);
+        } else if (option(argv[i], "--depth", &v)) {
+            maxDepth = atoi(v);
+        } else if (option(argv[i], "--ident-len", &v)) {
+            identLen = atoi(v);
+        } else if (option(argv[i], "--comments", &v)) {
+            comments = atof(v);
+        } else if (option(argv[i], "--underscores", &v)) {
+            underscores = atof(v);
+        } else if (option(argv[i], "--literals", &v)) {
+            literals = atof(v);
+        } else if (option(argv[i], "--vars", &v)) {
+            vars = atoi(v);
+        } else if (option(argv[i], "--digits", &v)) {
+            digits = std::max(1, atoi(v));
+        } else if (option(argv[i], "--terms", &v)) {
+            terms = std::max(1, atoi(v));
+        } else if (option(argv[i], "--factors", &v)) {
+            factors = std::max(1, atoi(v));
+        } else if (strcmp(argv[i], "--safe-div") == 0) {
+            safeDiv = true;
+        } else if (option(argv[i], "--seed", &v)) {
+            seed = strtoull(v, NULL, 10);
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--statements=N] [--size=BYTES] [--depth=D] [--ident-len=L]"
+                         " [--comments=P] [--underscores=P] [--literals=P] [--vars=N]"
+                         " [--digits=D] [--terms=N] [--factors=N] [--safe-div] [--seed=S]\n";
+            return 1;
+        }
+    }
+    rng.seed(seed);
+    for (int v = 0; v < vars; v++) {
+        out.clear();
+        freshIdentifier();
+        names.push_back(out);
+    }
+    out.clear();
+
+    out += "~ generated by bench/gen\n\nbegin\n";
+    long long written = 0;
+    for (long long i = 0; sizeLimit > 0 || i < statements; i++) {
+        if (chance() < comments) {
+            out += "~ comment line in the body of the program\n";
+        }
+        out += "  ";
+        identifier();
+        out += " = ";
+        expr(0);
+        out += ";\n";
+
+        if (out.size() >= (1 << 16)) {
+            written += (long long)out.size();
+            flush();
+        }
+        if (sizeLimit > 0 && written + (long long)out.size() >= sizeLimit) {
+            break;
+        }
+    }
+    out += "end.\n";
+    flush();
+    return 0;
+}
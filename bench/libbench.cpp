@@ -0,0 +1,155 @@
+/*
+  libbench - in-process parse() calls vs spawning ./main
+
+  Reads each file once, then times parse() from parser.h on it (also
+  from several threads at once, checking every result matches) and
+  times running ./main on the same file as a child process, the way a
+  service without the library would.
+
+  Usage: libbench [--runs=N] [--spawns=M] [--threads=T] [--main=PATH] <file>...
+    --runs     timed in-process calls per file (default 10000)
+    --spawns   timed process spawns per file (default 200)
+    --threads  threads calling parse() concurrently (default 4)
+    --main     the executable to spawn (default ./main)
+*/
+
+#include "../parser.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <spawn.h>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+extern char** environ;
+
+typedef std::chrono::steady_clock Clock;
+
+static double since(Clock::time_point t0) {
+    return std::chrono::duration<double>(Clock::now() - t0).count();
+}
+
+/* report - one row: median and mean of per-call times in microseconds */
+static void report(const char* what, std::vector<double>& t) {
+    std::sort(t.begin(), t.end());
+    double sum = 0;
+    for (double x : t) {
+        sum += x;
+    }
+    printf("  %-22s %10.2f %10.2f %10zu\n", what, t[t.size() / 2] * 1e6, sum / t.size() * 1e6, t.size());
+}
+
+/* spawn - run main on path with its output discarded; its exit status */
+static int spawn(const char* mainPath, const char* path) {
+    posix_spawn_file_actions_t fa;
+    posix_spawn_file_actions_init(&fa);
+    posix_spawn_file_actions_addopen(&fa, 1, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addopen(&fa, 2, "/dev/null", O_WRONLY, 0);
+    char* argv[] = { (char*)mainPath, (char*)path, NULL };
+    pid_t pid;
+    int status = -1;
+    if (posix_spawn(&pid, mainPath, &fa, NULL, argv, environ) == 0) {
+        waitpid(pid, &status, 0);
+    }
+    posix_spawn_file_actions_destroy(&fa);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+int main(int argc, char* argv[]) {
+    int runs = 10000, spawns = 200, threads = 4;
+    const char* mainPath = "./main";
+    std::vector<const char*> files;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--runs=", 7) == 0 && atoi(argv[i] + 7) > 0) {
+            runs = atoi(argv[i] + 7);
+        } else if (strncmp(argv[i], "--spawns=", 9) == 0 && atoi(argv[i] + 9) > 0) {
+            spawns = atoi(argv[i] + 9);
+        } else if (strncmp(argv[i], "--threads=", 10) == 0 && atoi(argv[i] + 10) > 0) {
+            threads = atoi(argv[i] + 10);
+        } else if (strncmp(argv[i], "--main=", 7) == 0) {
+            mainPath = argv[i] + 7;
+        } else if (argv[i][0] == '-' && argv[i][1] == '-') {
+            files.clear();
+            break;
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+    if (files.empty()) {
+        fprintf(stderr, "Usage: %s [--runs=N] [--spawns=M] [--threads=T] [--main=PATH] <file>...\n", argv[0]);
+        return 1;
+    }
+
+    int failures = 0;
+    for (const char* path : files) {
+        FILE* f = fopen(path, "rb");
+        if (f == NULL) {
+            fprintf(stderr, "ERROR - cannot open %s\n", path);
+            return 1;
+        }
+        std::string text;
+        char buf[65536];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+            text.append(buf, n);
+        }
+        fclose(f);
+
+        ParseOptions opts;
+        opts.name = path;
+        ParseResult first = parse(text.data(), text.size(), opts);
+        printf("%s: %zu bytes, %s\n", path, text.size(), first.ok ? "valid" : "syntax error");
+        printf("  %-22s %10s %10s %10s\n", "", "p50 us", "mean us", "calls");
+
+        std::vector<double> t;
+        for (int k = 0; k < runs; k++) {
+            Clock::time_point t0 = Clock::now();
+            ParseResult r = parse(text.data(), text.size(), opts);
+            t.push_back(since(t0));
+            failures += r.ok != first.ok || r.diag != first.diag;
+        }
+        report("parse() in process", t);
+
+        // concurrent callers must see exactly the single-threaded result
+        std::vector<std::vector<double>> tt(threads);
+        std::vector<int> bad(threads, 0);
+        std::vector<std::thread> pool;
+        for (int j = 0; j < threads; j++) {
+            pool.emplace_back([&, j] {
+                for (int k = 0; k < runs / threads; k++) {
+                    Clock::time_point t0 = Clock::now();
+                    ParseResult r = parse(text.data(), text.size(), opts);
+                    tt[j].push_back(since(t0));
+                    bad[j] += r.ok != first.ok || r.diag != first.diag;
+                }
+            });
+        }
+        t.clear();
+        for (int j = 0; j < threads; j++) {
+            pool[j].join();
+            t.insert(t.end(), tt[j].begin(), tt[j].end());
+            failures += bad[j];
+        }
+        char label[32];
+        snprintf(label, sizeof(label), "parse() x%d threads", threads);
+        report(label, t);
+
+        t.clear();
+        for (int k = 0; k < spawns; k++) {
+            Clock::time_point t0 = Clock::now();
+            int status = spawn(mainPath, path);
+            t.push_back(since(t0));
+            failures += (status == 0) != first.ok;
+        }
+        report("spawn ./main", t);
+    }
+    printf("mismatched results: %d\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -15,86 +15,158 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cctype>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <sys/resource.h>
+#include <fcntl.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
 
-// ---------- Globals ----------
-int  charClass;
-char lexeme[100];
-char nextChar;
-int  lexLen;
-int  nextToken;
+#include "compiler.h"
+#include "parser.h"
+
+// ---------- Global definitions (declared in compiler.h) ----------
+// Globals
+thread_local int  charClass;
+thread_local char lexeme[100];
+thread_local char nextChar;
+thread_local int  lexLen;
+thread_local int  nextToken;
+thread_local int64_t lexValue;
+thread_local bool    lexBig;
 FILE* in_fp;
+thread_local const char* srcPath = "";  // file name for diagnostics
+
+// Input buffer (streaming mode)
+unsigned char inBuf[IN_BUF_SIZE];
+size_t        inPos = 0;
+size_t        inLen = 0;
+uint64_t      inBase = 0;          // byte offset of inBuf[0] in the input
+thread_local uint64_t tokStart;    // byte offset of the current token
+bool          inSeekable = false;
+uint64_t      inLines = 0;         // newlines before inBuf (pipes)
+uint64_t      inLineStart = 0;     // offset just past the last of them
+thread_local int depth = 0;
+
+// Token buffer (pre-lexed mode)
+std::vector<Token> tokenBuf;               // main thread's token array
+int                lexJobs = 1;            // --jobs=N: lexer threads
+thread_local bool         useTokens = false;
+thread_local const char*  source = "";     // whole input, pre-lexed mode only
+thread_local size_t       sourceLen = 0;
+thread_local const Token* tokens = NULL;
+thread_local size_t       tokenCount = 0;
+thread_local size_t       tokPos = (size_t)-1; // index of current token (before first)
+thread_local std::vector<uint32_t> lineStarts;  // newline index of source, built by lineCol()
+int                parseJobs = 1;          // --parse-jobs=N: statement parser threads
+int                benchTrials = 0;        // --bench[=N]: timed runs per phase
+int                editTrials = 0;         // --bench-edits[=N]: timed edits
+
+// Stats (--stats)
+bool  statsOn = false;
+Stats stats;
+thread_local int maxDepthSeen = 0;
+
+// Perf counters (--perf-counters)
+bool      perfOn = false;
+int       perfFd[PERF_EVENTS] = { -1, -1, -1, -1 };
+int       perfErrno = 0;               // why the first counter failed to open
+PerfPhase perfPhase[PERF_PHASES];
+int       perfPhases = 0;
+int       perfActive = -1;             // phase being counted, or -1
+
+// Trace (--trace=FILE)
+bool                  traceOn = false;
+const char*           tracePath = NULL;
+Clock::time_point     traceStart;
+TraceBuf*             traceBufs[TRACE_THREADS];
+std::atomic<int>      traceThreads{0};
+thread_local TraceBuf* traceBuf = NULL;
+
+// Result cache (--cache=DIR)
+const char* cacheDir = NULL;
+
+// AST (--eval, --emit-binary)
+thread_local Ast* ast = NULL;
+bool        evalOn = false;          // --eval: run the program, print variables
+const char* emitPath = NULL;         // --emit-binary=FILE
+bool        loadBinaryOn = false;    // --load-binary: input is an emitted file
+bool        balanceOn = true;        // --no-balance clears: keep chains left-deep
+bool        divMagicOn = true;       // --no-div-magic clears: always divide
+thread_local std::vector<ChainTerm> chainTerms;  // operands of the open chains
+thread_local std::vector<ChainTerm> chainNeg;
 
-// ---------- Character classes ----------
-#define LETTER  0
-#define DIGIT   1
-#define UNKNOWN 99
-
-// ---------- Token codes ----------
-#define INT_LIT     10
-#define IDENT       11
-#define ASSIGN_OP   20
-#define ADD_OP      21
-#define SUB_OP      22
-#define MULT_OP     23
-#define DIV_OP      24
-#define LEFT_PAREN  25
-#define RIGHT_PAREN 26
-#define UNDERSCORE  28
-#define END_PERIOD  29
-#define BEGIN       30
-#define END         31
-#define SEMICOLON   32
-
-// ---------- Lexer declarations ----------
-void addChar();
-void getChar();
-void getNonBlank();
-int  lex();
-int  lookup(char ch);
-
-// ---------- Parser declarations ----------
-void program();
-void statement_list();
-void statement();
-void assignment_statement();
-void expr();
-void term();
-void factor();
-void identifier();
+// Exact integers (--exact)
+bool exactOn = false;
+
+// Bytecode VM (--vm)
+bool vmOn = false;
+int  vmPasses = BC_PASSES;
+
+// Syntax errors (see ParseFailed)
+thread_local bool trapErrors = false;
 
 // ---------- error ----------
+
 [[noreturn]] void error(const char* message) {
-    std::cerr << "Error: " << message << "\n"
-              << "NextToken: " << nextToken << "\n"
-              << "NextChar: " << (nextChar == (char)EOF ? ' ' : nextChar) << "\n"
-              << "Lexeme: " << lexeme << "\n";
+    if (trapErrors) {
+        throw ParseFailed{message};
+    }
+    std::cerr << formatError(message);
     std::exit(1);
 }
 
-// ---------- main ----------
-int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <source_file>\n";
-        return 1;
-    }
-
-    if ((in_fp = fopen(argv[1], "r")) == NULL) {
-        std::cerr << "ERROR - cannot open " << argv[1] << "\n";
-        return 1;
-    }
-
-    getChar(); // prime first character
-    lex();     // prime first token
-
-    program();
+/* formatError - diagnostic text for the current token */
+std::string formatError(const char* message) {
+    uint64_t line, col;
+    std::string out = errorBody(message, line, col);
+    return out + errorLocation(srcPath, line, col);
+}
 
-    if (nextToken != EOF) {
-        error("Unexpected symbols after end of program");
+/* errorBody - diagnostic text without the Location line, which needs
+   the file name; the position is returned for errorLocation() */
+std::string errorBody(const char* message, uint64_t& line, uint64_t& col) {
+    if (useTokens) {
+        // rebuild lexeme/nextChar from the current token
+        const Token& t = tokens[tokPos];
+        if (t.kind == EOF && t.length == 0) {
+            strcpy(lexeme, "EOF");
+        } else {
+            memcpy(lexeme, source + t.offset, t.length);
+            lexeme[t.length] = '\0';
+        }
+        size_t after = (size_t)t.offset + t.length;
+        nextChar = after < sourceLen ? source[after] : (char)EOF;
     }
+    lineCol(useTokens ? (uint64_t)tokens[tokPos].offset : tokStart, line, col);
+    std::string out = "Error: ";
+    out += message;
+    out += "\nNextToken: " + std::to_string(nextToken);
+    out += "\nNextChar: ";
+    out += nextChar == (char)EOF ? ' ' : nextChar;
+    out += "\nLexeme: ";
+    out += lexeme;
+    out += "\n";
+    return out;
+}
 
-    std::cout << "Parsing completed successfully.\n";
-    fclose(in_fp);
-    return 0;
+/* errorLocation - the final "Location: path:line:col" diagnostic line */
+std::string errorLocation(const char* path, uint64_t line, uint64_t col) {
+    return std::string("Location: ") + path + ":" + std::to_string(line) + ":" + std::to_string(col) + "\n";
 }
 
 /*****************************************************/
@@ -144,9 +216,12 @@ int lookup(char ch) {
 
         case '~': {
             // skip comment: consume chars until newline or EOF
+            uint64_t skipped = 0;
             while (nextChar != '\n' && nextChar != (char)EOF) {
                 getChar();
+                skipped++;
             }
+            STATS(stats.commentBytes += skipped);
             if (nextChar == '\n') getChar(); // consume newline
             nextToken = UNKNOWN;             // tell lex() to restart
             break;
@@ -176,7 +251,10 @@ void addChar() {
 /* getChar - get next character and classify */
 // static_cast to force typing
 void getChar() {
-    int c = getc(in_fp);
+    int c = EOF;
+    if (inPos < inLen || fillInput()) {
+        c = inBuf[inPos++];
+    }
     if (c != EOF) {
         nextChar = static_cast<char>(c);
         if (isalpha(static_cast<unsigned char>(nextChar))) {
@@ -192,6 +270,102 @@ void getChar() {
     }
 }
 
+/*****************************************************/
+/* scanNewlines - call onNewline(i) for each '\n' at p[i], i < n;
+   16 bytes per step with SSE2 */
+template <class F>
+void scanNewlines(const char* p, size_t n, F onNewline) {
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i nl = _mm_set1_epi8('\n');
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+        unsigned m = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl));
+        while (m != 0) {
+            onNewline(i + __builtin_ctz(m));
+            m &= m - 1;
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        if (p[i] == '\n') {
+            onNewline(i);
+        }
+    }
+}
+
+/*****************************************************/
+/*
+lineCol - 1-based line and column of a byte offset. Only called for
+diagnostics: the newline index of a mapped source is built on first
+use, a streamed file is rescanned from the start, and a pipe uses the
+counts kept by fillInput() plus the current buffer.
+*/
+void lineCol(uint64_t offset, uint64_t& line, uint64_t& col) {
+    uint64_t lines = 0, start = 0;
+    if (useTokens) {
+        if (lineStarts.empty()) {
+            lineStarts.push_back(0);
+            scanNewlines(source, sourceLen, [](size_t i) {
+                lineStarts.push_back((uint32_t)(i + 1));
+            });
+        }
+        size_t k = std::upper_bound(lineStarts.begin(), lineStarts.end(), offset)
+                   - lineStarts.begin();
+        lines = k - 1;
+        start = lineStarts[k - 1];
+    } else if (inSeekable) {
+        char buf[IN_BUF_SIZE];
+        uint64_t at = 0;
+        while (at < offset) {
+            size_t want = (size_t)std::min<uint64_t>(sizeof(buf), offset - at);
+            ssize_t n = pread(fileno(in_fp), buf, want, (off_t)at);
+            if (n <= 0) {
+                break;
+            }
+            scanNewlines(buf, (size_t)n, [&](size_t i) {
+                lines++;
+                start = at + i + 1;
+            });
+            at += (uint64_t)n;
+        }
+    } else {
+        lines = inLines;
+        start = inLineStart;
+        if (offset > inBase) {
+            scanNewlines((const char*)inBuf, (size_t)(offset - inBase), [&](size_t i) {
+                lines++;
+                start = inBase + i + 1;
+            });
+        }
+    }
+    line = lines + 1;
+    col = offset - start + 1;
+}
+
+/*****************************************************/
+/* fillInput - refill inBuf from in_fp; false at end of input */
+bool fillInput() {
+    Clock::time_point t0;
+    STATS(t0 = Clock::now());
+    if (!inSeekable) {
+        scanNewlines((const char*)inBuf, inLen, [](size_t i) {
+            inLines++;
+            inLineStart = inBase + i + 1;
+        });
+    }
+    inBase += inLen;
+
+    ssize_t n;
+    do {
+        n = read(fileno(in_fp), inBuf, IN_BUF_SIZE);
+    } while (n < 0 && errno == EINTR);
+    inPos = 0;
+    inLen = n > 0 ? (size_t)n : 0;
+    STATS(stats.io += since(t0));
+    return inLen > 0;
+}
+
 /*****************************************************/
 /* getNonBlank - skip whitespace */
 void getNonBlank() {
@@ -206,11 +380,28 @@ int lex() {
     lexLen = 0;
     getNonBlank();
 
+    // skip comments in a loop, so long comment runs use no stack
+    while (nextChar == '~' && charClass == UNKNOWN) {
+        lookup(nextChar);
+        getNonBlank();
+    }
+    tokStart = charClass == EOF ? inBase + inLen : inBase + inPos - 1;
+
     switch (charClass) {
         case LETTER: {
+            // identifier: letters/digits with single '_' separators,
+            // '_' may be last but never doubled
             addChar();
             getChar();
-            while (charClass == LETTER || charClass == DIGIT) {
+            while (charClass == LETTER || charClass == DIGIT || nextChar == '_') {
+                if (nextChar == '_') {
+                    addChar();
+                    getChar();
+                    if (nextChar == '_') {
+                        error("Consecutive underscores '__' not allowed in identifier");
+                    }
+                    continue;
+                }
                 addChar();
                 getChar();
             }
@@ -232,17 +423,15 @@ int lex() {
                 addChar();
                 getChar();
             }
+            uint64_t v;
+            bool over = decimalValue(lexeme, (size_t)lexLen, sizeof(lexeme), v);
+            lexValue = (int64_t)v;
+            lexBig = over || v > (uint64_t)INT64_MAX;
             nextToken = INT_LIT;
             break;
         }
 
         case UNKNOWN: {
-            // handle comments here too
-            if (nextChar == '~') {
-                lookup(nextChar); 
-                return lex(); // restart lex after comment
-            }
-
             lookup(nextChar);
             getChar();
             break;
@@ -255,9 +444,452 @@ int lex() {
             break;
     }
 
+    STATS(stats.tokenCount[(nextToken + 1) & 127]++);
+    return nextToken;
+}
+
+// ---------- Integer literals ----------
+// SWAR: eight ASCII bytes in one uint64_t, the first in the low byte
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define SWAR_DIGITS 1
+#endif
+
+/*****************************************************/
+/* digits8 - value of the 8 digits in x (already less '0' per byte),
+   combining neighbouring digits, then pairs, then quads */
+static inline uint64_t digits8(uint64_t x) {
+    x = (x * 10 + (x >> 8)) & 0x00FF00FF00FF00FFULL;
+    x = (x * 100 + (x >> 16)) & 0x0000FFFF0000FFFFULL;
+    return (x * 10000 + (x >> 32)) & 0xFFFFFFFFULL;
+}
+
+/* digitsLead - value of the k (1..8) digits at p, read as 8 bytes;
+   the bytes after them are shifted out, which leaves leading zeros */
+static inline uint64_t digitsLead(const char* p, size_t k) {
+    uint64_t x;
+    memcpy(&x, p, 8);
+    x -= 0x3030303030303030ULL;  // a borrow only moves to later bytes
+    return digits8(x << (8 * (8 - k)));
+}
+
+/*****************************************************/
+/*
+decimalValue - value of the n ASCII digits at p, modulo 2^64 like the
+arithmetic. Returns true if it does not fit in 64 bits. At least
+`avail` >= n bytes may be read from p; with 8 of them, a literal of up
+to 24 digits takes one 8-byte load per 8 digits and no per-digit
+branches. Only a literal of 20 or more digits can overflow.
+*/
+bool decimalValue(const char* p, size_t n, size_t avail, uint64_t& v) {
+#ifdef SWAR_DIGITS
+    if (n <= 8 && avail >= 8) {
+        v = digitsLead(p, n);
+        return false;
+    }
+    if (n > 8 && n <= 24) {
+        uint64_t low = digitsLead(p + n - 8, 8);
+        if (n <= 16) {
+            v = digitsLead(p, n - 8) * 100000000 + low;
+            return false;
+        }
+        low += digitsLead(p + n - 16, 8) * 100000000;
+        bool over = __builtin_mul_overflow(digitsLead(p, n - 16), (uint64_t)10000000000000000, &v);
+        return __builtin_add_overflow(v, low, &v) || over;
+    }
+#else
+    (void)avail;
+#endif
+    bool over = false;
+    v = 0;
+    for (size_t i = 0; i < n; i++) {
+        over |= __builtin_mul_overflow(v, (uint64_t)10, &v);
+        over |= __builtin_add_overflow(v, (uint64_t)(p[i] - '0'), &v);
+    }
+    return over;
+}
+
+/*****************************************************/
+/*
+digitRun - index of the first non-digit in src[i, end), eight bytes at
+a time: a byte is a digit iff its high nibble is 3 both as it is and
+after adding 6. A carry out of a non-digit byte can only disturb the
+bytes after it.
+*/
+size_t digitRun(const char* src, size_t i, size_t end) {
+#ifdef SWAR_DIGITS
+    const uint64_t hi = 0xF0F0F0F0F0F0F0F0ULL, three = 0x3030303030303030ULL;
+    for (; i + 8 <= end; i += 8) {
+        uint64_t x;
+        memcpy(&x, src + i, 8);
+        uint64_t bad = ((x & hi) ^ three) | (((x + 0x0606060606060606ULL) & hi) ^ three);
+        if (bad != 0) {
+            return i + (__builtin_ctzll(bad) >> 3);
+        }
+    }
+#endif
+    while (i < end && src[i] >= '0' && src[i] <= '9') {
+        i++;
+    }
+    return i;
+}
+
+/*****************************************************/
+/* character classes for tokenize() (C locale, same sets as cctype) */
+enum : unsigned char { C_LETTER = 1, C_DIGIT = 2, C_SPACE = 4 };
+
+struct CharTable {
+    unsigned char cls[256];
+    constexpr CharTable() : cls() {
+        for (int c = 'a'; c <= 'z'; c++) cls[c] = C_LETTER;
+        for (int c = 'A'; c <= 'Z'; c++) cls[c] = C_LETTER;
+        for (int c = '0'; c <= '9'; c++) cls[c] = C_DIGIT;
+        cls[(int)' '] = cls[(int)'\t'] = cls[(int)'\n'] = C_SPACE;
+        cls[(int)'\v'] = cls[(int)'\f'] = cls[(int)'\r'] = C_SPACE;
+    }
+};
+constexpr CharTable charTable;
+
+static inline Token makeToken(int kind, size_t offset, size_t length) {
+    Token t;
+    t.kind = kind;
+    t.length = (uint32_t)length;
+    t.offset = (uint32_t)offset;
+    return t;
+}
+
+/*****************************************************/
+/*
+tokenize - lex src[begin, end) into out, ending with an EOF token.
+Same rules as lex(), but works on a memory buffer with no globals.
+An unknown character yields an EOF token (like lookup()); a lexical
+error yields a LEX_ERR_* token. Either one ends the array unless
+`whole` is set; the parser never moves past such a token, so the
+tokens after it only matter to documents that are edited later.
+*/
+void tokenize(const char* src, size_t begin, size_t end, std::vector<Token>& out, bool whole) {
+    const unsigned char* cls = charTable.cls;
+    size_t i = begin;
+
+    for (;;) {
+        while (i < end && (cls[(unsigned char)src[i]] & C_SPACE)) {
+            i++;
+        }
+        if (i >= end) {
+            out.push_back(makeToken(EOF, i, 0));
+            return;
+        }
+
+        size_t start = i;
+        unsigned char c = cls[(unsigned char)src[i]];
+        int kind;
+
+        if (c & C_LETTER) {
+            kind = IDENT;
+            i++;
+            while (i < end) {
+                if (cls[(unsigned char)src[i]] & (C_LETTER | C_DIGIT)) {
+                    i++;
+                } else if (src[i] == '_') {
+                    i++;
+                    if (i < end && src[i] == '_') {
+                        kind = LEX_ERR_UNDERSCORE;
+                        break;
+                    }
+                } else {
+                    break;
+                }
+            }
+            if (kind == IDENT) {
+                if (i - start == 5 && memcmp(src + start, "begin", 5) == 0) {
+                    kind = BEGIN;
+                } else if (i - start == 3 && memcmp(src + start, "end", 3) == 0) {
+                    kind = END;
+                }
+            }
+        } else if (c & C_DIGIT) {
+            kind = INT_LIT;
+            i = digitRun(src, i + 1, end);
+        } else {
+            switch (src[i]) {
+                case '(': kind = LEFT_PAREN;  break;
+                case ')': kind = RIGHT_PAREN; break;
+                case '+': kind = ADD_OP;      break;
+                case '-': kind = SUB_OP;      break;
+                case '*': kind = MULT_OP;     break;
+                case '/': kind = DIV_OP;      break;
+                case '_': kind = UNDERSCORE;  break;
+                case '.': kind = END_PERIOD;  break;
+                case ';': kind = SEMICOLON;   break;
+                case '=': kind = ASSIGN_OP;   break;
+                case '~': {
+                    // comment runs to end of line
+                    size_t from = i;
+                    while (i < end && src[i] != '\n') {
+                        i++;
+                    }
+                    STATS(stats.commentBytes += i - from);
+                    continue;
+                }
+                default:
+                    kind = EOF;
+                    break;
+            }
+            i++;
+        }
+
+        // lex() stops at 99 characters
+        if (i - start > 99) {
+            kind = LEX_ERR_TOO_LONG;
+            i = start + 99;
+        }
+
+        out.push_back(makeToken(kind, start, i - start));
+        if (!whole && (kind == EOF || kind == LEX_ERR_UNDERSCORE || kind == LEX_ERR_TOO_LONG)) {
+            return;
+        }
+    }
+}
+
+/*****************************************************/
+/*
+tokenizeParallel - split src at line starts into chunks, tokenize them
+concurrently and stitch the arrays. Comments end at a newline and no
+token spans one, so every chunk starts in the default lexer state.
+*/
+void tokenizeParallel(const char* src, size_t len, int jobs, std::vector<Token>& out) {
+    const size_t minChunk = 1 << 20; // below this a thread costs more than it saves
+    jobs = (int)std::min<size_t>(jobs, len / minChunk + 1);
+    if (jobs <= 1) {
+        out.reserve(len / 3 + 1);
+        tokenize(src, 0, len, out);
+        return;
+    }
+
+    // chunk j is src[cut[j], cut[j+1]), each cut just after a newline
+    std::vector<size_t> cut(jobs + 1);
+    cut[0] = 0;
+    cut[jobs] = len;
+    for (int j = 1; j < jobs; j++) {
+        size_t p = std::max(cut[j - 1], len / jobs * j);
+        const char* nl = (const char*)memchr(src + p, '\n', len - p);
+        cut[j] = nl ? (size_t)(nl - src) + 1 : len;
+    }
+
+    std::vector<std::vector<Token>> part(jobs);
+    std::vector<std::thread> pool;
+    for (int j = 0; j < jobs; j++) {
+        pool.emplace_back([&, j] {
+            traceThread("lexer");
+            TraceSpan span("lex chunk");
+            part[j].reserve((cut[j + 1] - cut[j]) / 3 + 1);
+            tokenize(src, cut[j], cut[j + 1], part[j]);
+        });
+    }
+    for (std::thread& t : pool) {
+        t.join();
+    }
+    pool.clear();
+
+    // drop each chunk's closing EOF; a chunk that stopped early (unknown
+    // character or lexical error) ends the whole array
+    std::vector<size_t> at(jobs + 1, 0);
+    int last = jobs - 1;
+    for (int j = 0; j < jobs; j++) {
+        const Token& t = part[j].back();
+        bool chunkEnd = t.kind == EOF && t.length == 0;
+        if (!chunkEnd || j == jobs - 1) {
+            at[j + 1] = at[j] + part[j].size();
+            last = j;
+            break;
+        }
+        at[j + 1] = at[j] + part[j].size() - 1;
+    }
+
+    out.resize(at[last + 1]);
+    for (int j = 0; j <= last; j++) {
+        pool.emplace_back([&, j] {
+            traceThread("lexer");
+            TraceSpan span("stitch");
+            std::copy(part[j].begin(), part[j].begin() + (at[j + 1] - at[j]), out.begin() + at[j]);
+            std::vector<Token>().swap(part[j]);
+        });
+    }
+    for (std::thread& t : pool) {
+        t.join();
+    }
+}
+
+/*****************************************************/
+/* loadSource - mmap the open file into source/sourceLen */
+bool loadSource(FILE* fp) {
+    return mapFile(fileno(fp), source, sourceLen);
+}
+
+/*****************************************************/
+/* mapFile - mmap a whole file read-only ("" for an empty file) */
+bool mapFile(int fd, const char*& data, size_t& len) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return false;
+    }
+    len = (size_t)st.st_size;
+    if (len == 0) {
+        data = "";
+        return true;
+    }
+    void* p = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    madvise(p, len, MADV_SEQUENTIAL);
+    data = (const char*)p;
+    return true;
+}
+
+/*****************************************************/
+/* useTokenArray - point this thread's parser at a pre-lexed input */
+void useTokenArray(const char* src, size_t len, const std::vector<Token>& toks) {
+    useTokens = true;
+    source = src;
+    sourceLen = len;
+    tokens = toks.data();
+    tokenCount = toks.size();
+    tokPos = (size_t)-1;
+    lineStarts.clear();
+}
+
+/*****************************************************/
+/*
+parseBuffer - parse an in-memory program on the calling thread, in
+pre-lexed mode with a per-thread token array that keeps its capacity
+between calls. On failure diag gets the text error() would print.
+*/
+bool parseBuffer(const char* buf, size_t len, const char* name, std::string& diag) {
+    uint64_t line, col;
+    if (parseTrapped(buf, len, name, diag, line, col)) {
+        return true;
+    }
+    if (line != 0) {
+        diag += errorLocation(name, line, col);
+    }
+    return false;
+}
+
+/*****************************************************/
+/*
+parse - the library entry point (parser.h): parseBuffer() plus, with
+opts.eval, evaluation of the program. The thread's token array and AST
+keep their capacity between calls.
+*/
+ParseResult parse(const char* buf, size_t len, const ParseOptions& opts) {
+    static thread_local Ast built;
+    static thread_local std::vector<int64_t> vars;
+    const char* name = opts.name != NULL ? opts.name : "<buffer>";
+    ParseResult r;
+    if (opts.eval) {
+        built.nodes.clear();
+        built.stmts.clear();
+        built.consts.clear();
+        built.syms.clear();
+        built.names.clear();
+        built.symIndex.clear();
+        built.bigLits.clear();
+        ast = &built;
+    }
+    r.ok = parseTrapped(buf, len, name, r.diag, r.line, r.col);
+    ast = NULL;
+    if (!r.ok) {
+        if (r.line != 0) {
+            r.diag += errorLocation(name, r.line, r.col);
+        }
+        return r;
+    }
+    if (opts.eval && opts.exact) {
+        ExactState st;
+        r.ok = evalExact(built, st, r.diag);
+        if (r.ok) {
+            formatExact(built, st, r.output);
+        }
+    } else if (opts.eval) {
+        Program prog = astProgram(built);
+        vars.assign(prog.symCount, 0);
+        r.ok = evalProgram(prog, vars, r.diag);
+        if (r.ok) {
+            formatValues(prog, vars, r.output);
+        }
+    }
+    return r;
+}
+
+/*****************************************************/
+/* parseTrapped - parseBuffer() without the Location line: on a syntax
+   error `body` is the rest of the diagnostic and line/col its position
+   (line 0 when the input could not be parsed at all) */
+bool parseTrapped(const char* buf, size_t len, const char* name, std::string& body,
+                         uint64_t& line, uint64_t& col) {
+    static thread_local std::vector<Token> toks;
+    line = col = 0;
+    if (len > UINT32_MAX) {
+        body = std::string("ERROR - ") + name + " is too large (4 GiB max)\n";
+        return false;
+    }
+    toks.clear();
+    tokenize(buf, 0, len, toks);
+    useTokenArray(buf, len, toks);
+    srcPath = name;
+
+    bool trapping = trapErrors;
+    bool ok = true;
+    trapErrors = true;
+    try {
+        advance();
+        program();
+        if (nextToken != EOF) {
+            error("Unexpected symbols after end of program");
+        }
+    } catch (const ParseFailed& e) {
+        body = errorBody(e.message, line, col);
+        ok = false;
+    }
+    trapErrors = trapping;
+    depth = 0;
+    return ok;
+}
+
+/*****************************************************/
+/* advance - move to the next token: lex() when streaming, otherwise
+   the next entry of the pre-lexed token array */
+int advance() {
+    if (!useTokens) {
+        return lex();
+    }
+
+    if (tokPos + 1 < tokenCount) { // never step past the final token
+        ++tokPos;
+    }
+
+    const Token& t = tokens[tokPos];
+    if (t.kind == LEX_ERR_UNDERSCORE) {
+        error("Consecutive underscores '__' not allowed in identifier");
+    }
+    if (t.kind == LEX_ERR_TOO_LONG) {
+        error("lexeme is too long");
+    }
+
+    nextToken = t.kind;
     return nextToken;
 }
 
+/*****************************************************/
+/* peek - token code k tokens after the current one (pre-lexed mode) */
+int peek(size_t k) {
+    if (!useTokens) {
+        return k == 0 ? nextToken : EOF;
+    }
+    size_t i = tokPos + k;
+    return i < tokenCount ? (int)tokens[i].kind : EOF;
+}
+
 /*****************************************************/
 /*
 program = "begin", statement_list, "end", "." ;
@@ -266,19 +898,25 @@ void program() {
     if (nextToken != BEGIN) {
         error("Program must start with 'begin'");
     }
-    lex(); // consume BEGIN
+    advance(); // consume BEGIN
 
     statement_list();
 
+    program_end();
+}
+
+/*****************************************************/
+/* program_end - the closing "end", "." of program */
+void program_end() {
     if (nextToken != END) {
         error("Program must end with 'end'");
     }
-    lex(); // consume END
+    advance(); // consume END
 
     if (nextToken != END_PERIOD) {
         error("Missing '.' after 'end'");
     }
-    lex(); // consume '.'
+    advance(); // consume '.'
 }
 
 /*****************************************************/
@@ -306,71 +944,93 @@ void statement() {
 assignment_statement = identifier, "=", expr, ";" ;
 */
 void assignment_statement() {
-    identifier();
+    uint32_t target = identifier();
 
     if (nextToken != ASSIGN_OP) {
         error("Assignment operator '=' missing in assignment_statement");
     }
-    lex(); // consume '='
+    advance(); // consume '='
 
-    expr();
+    uint32_t first = 0;
+    if (ast) {
+        first = (uint32_t)ast->nodes.size();
+        chainTerms.clear();  // left over if the last statement failed
+    }
+    uint32_t root = expr();
 
     if (nextToken != SEMICOLON) {
         error("Semicolon ';' missing at end of assignment_statement");
     }
-    lex(); // consume ';'
+    advance(); // consume ';'
+
+    if (ast) {
+        ast->stmts.push_back(Stmt{ target, first, root });
+    }
 }
 
 /*****************************************************/
 /*
 expr = term, { ("+" | "-"), term } ;
 */
-void expr() {
-    term();
+uint32_t expr() {
+    uint32_t left = term();
+    size_t chain = astChainStart();
 
     while (nextToken == ADD_OP || nextToken == SUB_OP) {
-        lex(); // consume +/- 
-        term();
+        int op = nextToken;
+        advance(); // consume +/- 
+        left = astChainNode(op, left, term(), chain);
     }
+    return astChainEnd(ADD_OP, left, chain);
 }
 
 /*****************************************************/
 /*
 term = factor, { ("*" | "/"), factor } ;
 */
-void term() {
-    factor();
+uint32_t term() {
+    uint32_t left = factor();
+    size_t chain = astChainStart();
 
     while (nextToken == MULT_OP || nextToken == DIV_OP) {
-        lex(); // consume */ 
-        factor();
+        int op = nextToken;
+        advance(); // consume */ 
+        if (op == DIV_OP) {
+            // before the divisor's nodes, so a literal divisor is the last one
+            left = astChainEnd(MULT_OP, left, chain);
+        }
+        left = astChainNode(op, left, factor(), chain);
     }
+    return astChainEnd(MULT_OP, left, chain);
 }
 
 /*****************************************************/
 /*
 factor = identifier | number | "(", expr, ")" ;
 */
-void factor() {
-    if (nextToken == IDENT) {
-        identifier();
-        return;
-    }
-
-    if (nextToken == INT_LIT) {
-        lex(); // consume number
-        return;
+uint32_t factor() {
+    if (nextToken == IDENT || nextToken == INT_LIT) {
+        if (__builtin_expect(ast != NULL, 0)) {
+            return astLeaf();
+        }
+        advance(); // consume identifier or number
+        return 0;
     }
 
     if (nextToken == LEFT_PAREN) {
-        lex(); // consume '('
-        expr();
+        if (++depth > MAX_DEPTH) {
+            error("Expression nested too deeply");
+        }
+        STATS(maxDepthSeen = std::max(maxDepthSeen, depth));
+        advance(); // consume '('
+        uint32_t inner = expr();
+        depth--;
 
         if (nextToken != RIGHT_PAREN) {
             error("Right parenthesis ')' expected");
         }
-        lex(); // consume ')'
-        return;
+        advance(); // consume ')'
+        return inner;
     }
 
     error("Expected identifier, number, or '(' in factor");
@@ -378,30 +1038,2289 @@ void factor() {
 
 /*****************************************************/
 /*
-identifier rules:
+identifier rules (enforced by lex(), which returns the whole identifier
+as a single IDENT token):
   - '_' cannot be first (must start with IDENT)
   - '_' can be last
   - no consecutive underscores
+Returns the identifier's symbol when building an AST.
 */
-void identifier() {
+uint32_t identifier() {
     if (nextToken != IDENT) {
         error("identifier must start with IDENT (letter)");
     }
 
-    lex(); // consume first IDENT chunk
+    uint32_t sym = ast ? astSymbol() : 0;
+    advance(); // consume IDENT
+    return sym;
+}
+
+/*****************************************************/
+/*
+parseParallel - program() with the statement list parsed on worker
+threads (pre-lexed mode). In a well-formed program every ';' between
+"begin" and the final "end" ends a statement, so the list is cut into
+slices just after SEMICOLON tokens and each slice is parsed on its own.
+The first failing slice (in source order) and the tail are then parsed
+sequentially from their first statement, which gives exactly the
+diagnostic a plain program() would report.
+*/
+void parseParallel(int jobs) {
+    // statements are tokens[1, tail), tail being the first token after
+    // the last ';'; slice j is tokens[cut[j], cut[j+1])
+    const size_t minSlice = 1 << 16;
+    size_t tail = tokenCount;
+    while (tail > 0 && tokens[tail - 1].kind != SEMICOLON) {
+        tail--;
+    }
+    if (nextToken != BEGIN || tail < 2) {
+        program();
+        return;
+    }
+    jobs = (int)std::min<size_t>(jobs, (tail - 1) / minSlice + 1);
+    if (jobs <= 1) {
+        program();
+        return;
+    }
+
+    std::vector<size_t> cut;
+    cut.push_back(1);
+    for (int j = 1; j < jobs; j++) {
+        size_t p = std::max(cut.back(), 1 + (tail - 1) / jobs * j);
+        while (p < tail && tokens[p - 1].kind != SEMICOLON) {
+            p++;
+        }
+        if (p > cut.back() && p < tail) {
+            cut.push_back(p);
+        }
+    }
+    cut.push_back(tail);
+    size_t slices = cut.size() - 1;
 
-    while (nextToken == UNDERSCORE) {
-        lex(); // consume ONE underscore
+    std::vector<char> failed(slices, 0);
+    std::vector<std::thread> pool;
+    const char* src = source;
+    size_t srcLen = sourceLen;
+    const Token* toks = tokens;
+    size_t toksLen = tokenCount;
+    for (size_t j = 0; j < slices; j++) {
+        pool.emplace_back([&, j] {
+            traceThread("parser");
+            TraceSpan span("parse slice");
+            useTokens = true;
+            source = src;
+            sourceLen = srcLen;
+            tokens = toks;
+            tokenCount = toksLen;
+            trapErrors = true;
+            tokPos = cut[j] - 1;
+            try {
+                advance();
+                while (tokPos < cut[j + 1]) {
+                    statement();
+                }
+            } catch (const ParseFailed&) {
+                failed[j] = 1;
+            }
+            STATS(
+                int seen = stats.maxDepth.load();
+                while (maxDepthSeen > seen && !stats.maxDepth.compare_exchange_weak(seen, maxDepthSeen)) {
+                }
+            );
+        });
+    }
+    for (std::thread& t : pool) {
+        t.join();
+    }
 
-        if (nextToken == UNDERSCORE) {
-            error("Consecutive underscores '__' not allowed in identifier");
+    // resume sequentially at the first bad slice, or at the tail
+    size_t resume = tail;
+    for (size_t j = 0; j < slices; j++) {
+        if (failed[j]) {
+            resume = cut[j];
+            break;
+        }
+    }
+    tokPos = resume - 1;
+    advance();
+    if (resume == 1) {
+        statement_list();
+    } else {
+        while (nextToken == IDENT) {
+            statement();
         }
+    }
+    program_end();
+}
 
-        // underscore may be last
-        if (nextToken == IDENT || nextToken == INT_LIT) {
-            lex(); // consume next IDENT chunk and continue
-        } else {
-            break; // trailing underscore ends identifier
+/*****************************************************/
+/* since - seconds elapsed since t0 */
+double since(Clock::time_point t0) {
+    return std::chrono::duration<double>(Clock::now() - t0).count();
+}
+
+/*****************************************************/
+/* tokenName - printable name of a token code */
+static const char* tokenName(int code) {
+    switch (code) {
+        case EOF:                return "EOF";
+        case INT_LIT:            return "INT_LIT";
+        case IDENT:              return "IDENT";
+        case ASSIGN_OP:          return "ASSIGN_OP";
+        case ADD_OP:             return "ADD_OP";
+        case SUB_OP:             return "SUB_OP";
+        case MULT_OP:            return "MULT_OP";
+        case DIV_OP:             return "DIV_OP";
+        case LEFT_PAREN:         return "LEFT_PAREN";
+        case RIGHT_PAREN:        return "RIGHT_PAREN";
+        case UNDERSCORE:         return "UNDERSCORE";
+        case END_PERIOD:         return "END_PERIOD";
+        case BEGIN:              return "BEGIN";
+        case END:                return "END";
+        case SEMICOLON:          return "SEMICOLON";
+        case LEX_ERR_UNDERSCORE: return "LEX_ERR_UNDERSCORE";
+        case LEX_ERR_TOO_LONG:   return "LEX_ERR_TOO_LONG";
+        default:                 return "?";
+    }
+}
+
+/*****************************************************/
+/* countTokens - per-code token counts of a pre-lexed array (--stats) */
+void countTokens(const std::vector<Token>& toks) {
+    for (const Token& t : toks) {
+        stats.tokenCount[(t.kind + 1) & 127]++;
+    }
+}
+
+/*****************************************************/
+/* printStats - phase times and counters to stderr (--stats, atexit) */
+void printStats() {
+    double total = since(stats.start);
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+
+    fprintf(stderr, "---------- stats ----------\n");
+    fprintf(stderr, "%-24s %12.3f ms\n", "open", stats.open * 1e3);
+    // parse is not stamped when error() exits; use the remaining time
+    double rest = std::max(0.0, total - stats.open - stats.io - stats.lex - stats.eval);
+    if (useTokens) {
+        fprintf(stderr, "%-24s %12.3f ms\n", "map", stats.io * 1e3);
+        fprintf(stderr, "%-24s %12.3f ms\n", "lex", stats.lex * 1e3);
+        fprintf(stderr, "%-24s %12.3f ms\n", "parse", (stats.parse > 0 ? stats.parse : rest) * 1e3);
+    } else {
+        // lexing and parsing interleave token by token when streaming
+        fprintf(stderr, "%-24s %12.3f ms\n", "read (getChar I/O)", stats.io * 1e3);
+        fprintf(stderr, "%-24s %12.3f ms\n", "lex+parse", rest * 1e3);
+    }
+    if (evalOn) {
+        fprintf(stderr, "%-24s %12.3f ms\n", "eval", stats.eval * 1e3);
+    }
+    fprintf(stderr, "%-24s %12.3f ms\n", "total", total * 1e3);
+
+    uint64_t all = 0;
+    for (int k = 0; k < 128; k++) {
+        all += stats.tokenCount[k];
+    }
+    fprintf(stderr, "%-24s %12llu\n", "tokens", (unsigned long long)all);
+    for (int k = 0; k < 128; k++) {
+        if (stats.tokenCount[k] != 0) {
+            fprintf(stderr, "  %-22s %12llu\n", tokenName(k - 1),
+                    (unsigned long long)stats.tokenCount[k]);
+        }
+    }
+
+    int nest = std::max(stats.maxDepth.load(), maxDepthSeen);
+    fprintf(stderr, "%-24s %12d\n", "max expr()/factor() depth", nest + 1);
+    fprintf(stderr, "%-24s %12llu\n", "comment bytes skipped",
+            (unsigned long long)stats.commentBytes.load());
+    fprintf(stderr, "%-24s %12ld KiB\n", "peak RSS", ru.ru_maxrss);
+
+    if (cacheDir != NULL) {
+        uint64_t looked = stats.cacheLookups.load(), hits = stats.cacheHits.load();
+        fprintf(stderr, "%-24s %12.3f ms\n", "hash", stats.hash * 1e3);
+        fprintf(stderr, "%-24s %12llu / %llu (%.1f%%)\n", "cache hits", (unsigned long long)hits,
+                (unsigned long long)looked, looked > 0 ? 100.0 * hits / looked : 0.0);
+    }
+}
+
+/*****************************************************/
+/*
+perfOpen - open the hardware counters for this process (user space
+only, inherited by lexer/parser threads). Containers and VMs often
+refuse them; any counter that fails is left out of the report.
+*/
+void perfOpen() {
+#ifdef __linux__
+    const uint32_t type[PERF_EVENTS] = {
+        PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE
+    };
+    const uint64_t config[PERF_EVENTS] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_BRANCH_MISSES,
+        PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+            | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+    };
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type[e];
+        attr.config = config[e];
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        perfFd[e] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (perfFd[e] < 0 && perfErrno == 0) {
+            perfErrno = errno;
         }
     }
+#else
+    perfErrno = ENOSYS;
+#endif
+}
+
+/*****************************************************/
+/* perfRead - current value of counter e (0 if unavailable). Counters
+   run from perfOpen(); phases take deltas, because a reset would not
+   clear the counts folded in from exited worker threads */
+static uint64_t perfRead(int e) {
+    uint64_t v = 0;
+    if (perfFd[e] < 0 || read(perfFd[e], &v, sizeof(v)) != (ssize_t)sizeof(v)) {
+        return 0;
+    }
+    return v;
+}
+
+/*****************************************************/
+/* perfBegin - start counting a named phase */
+void perfBegin(const char* name) {
+    if (perfPhases == PERF_PHASES) {
+        return;
+    }
+    perfActive = perfPhases++;
+    perfPhase[perfActive].name = name;
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        perfPhase[perfActive].count[e] = perfRead(e);
+    }
 }
+
+/*****************************************************/
+/* perfEnd - store the active phase's counter deltas */
+void perfEnd() {
+    if (perfActive < 0) {
+        return;
+    }
+    PerfPhase& ph = perfPhase[perfActive];
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        ph.count[e] = perfRead(e) - ph.count[e];
+    }
+    // streaming mode knows the size only once the input is consumed
+    ph.bytes = useTokens ? sourceLen : inBase + inLen;
+    ph.tokens = useTokens ? tokenCount : 0;
+    if (!useTokens) {
+        for (int k = 0; k < 128; k++) {
+            ph.tokens += stats.tokenCount[k];
+        }
+    }
+    perfActive = -1;
+}
+
+/*****************************************************/
+/* printPerf - counter totals and per-byte/per-token ratios (atexit) */
+void printPerf() {
+    perfEnd(); // phase cut short by error()
+
+    fprintf(stderr, "---------- perf counters ----------\n");
+    bool any = false;
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        any = any || perfFd[e] >= 0;
+    }
+    if (!any) {
+        fprintf(stderr, "unavailable: perf_event_open: %s\n", strerror(perfErrno));
+        return;
+    }
+
+    const char* names[PERF_EVENTS] = { "cycles", "instructions", "branch-misses", "L1D-misses" };
+    for (int p = 0; p < perfPhases; p++) {
+        const PerfPhase& ph = perfPhase[p];
+        fprintf(stderr, "%s (%llu bytes, %llu tokens)\n", ph.name,
+                (unsigned long long)ph.bytes, (unsigned long long)ph.tokens);
+        for (int e = 0; e < PERF_EVENTS; e++) {
+            if (perfFd[e] < 0) {
+                fprintf(stderr, "  %-14s %16s\n", names[e], "n/a");
+                continue;
+            }
+            double c = (double)ph.count[e];
+            fprintf(stderr, "  %-14s %16llu %10.3f /byte", names[e],
+                    (unsigned long long)ph.count[e], ph.bytes ? c / ph.bytes : 0.0);
+            if (ph.tokens != 0) {
+                fprintf(stderr, " %10.3f /token", c / ph.tokens);
+            }
+            fprintf(stderr, "\n");
+        }
+        if (perfFd[0] >= 0 && perfFd[1] >= 0 && ph.count[0] != 0) {
+            fprintf(stderr, "  %-14s %16.2f\n", "IPC", (double)ph.count[1] / ph.count[0]);
+        }
+    }
+}
+
+/*****************************************************/
+/* writeAll - write n bytes, retrying short writes */
+bool writeAll(int fd, const char* p, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0 && errno == EINTR) {
+            continue;
+        }
+        if (w <= 0) {
+            return false;
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+    return true;
+}
+
+/*****************************************************/
+/*
+hash64 - XXH64 of len bytes. Four independent lanes over 32-byte
+stripes, then the remaining words and bytes folded in and avalanched;
+output matches the reference xxHash for the same seed.
+*/
+static inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read64(const unsigned char* p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static inline uint64_t xxRound(uint64_t acc, uint64_t input) {
+    const uint64_t P1 = 11400714785074694791ULL, P2 = 14029467366897019727ULL;
+    acc += input * P2;
+    return rotl64(acc, 31) * P1;
+}
+
+static inline uint64_t xxMerge(uint64_t acc, uint64_t val) {
+    const uint64_t P1 = 11400714785074694791ULL, P4 = 9650029242287828579ULL;
+    acc ^= xxRound(0, val);
+    return acc * P1 + P4;
+}
+
+uint64_t hash64(const void* data, size_t len, uint64_t seed) {
+    const uint64_t P1 = 11400714785074694791ULL, P2 = 14029467366897019727ULL;
+    const uint64_t P3 = 1609587929392839161ULL, P4 = 9650029242287828579ULL;
+    const uint64_t P5 = 2870177450012600261ULL;
+    const unsigned char* p = (const unsigned char*)data;
+    const unsigned char* end = p + len;
+    uint64_t h;
+
+    if (len >= 32) {
+        uint64_t v1 = seed + P1 + P2, v2 = seed + P2, v3 = seed, v4 = seed - P1;
+        do {
+            v1 = xxRound(v1, read64(p));
+            v2 = xxRound(v2, read64(p + 8));
+            v3 = xxRound(v3, read64(p + 16));
+            v4 = xxRound(v4, read64(p + 24));
+            p += 32;
+        } while (end - p >= 32);
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = xxMerge(h, v1);
+        h = xxMerge(h, v2);
+        h = xxMerge(h, v3);
+        h = xxMerge(h, v4);
+    } else {
+        h = seed + P5;
+    }
+    h += (uint64_t)len;
+
+    for (; end - p >= 8; p += 8) {
+        h ^= xxRound(0, read64(p));
+        h = rotl64(h, 27) * P1 + P4;
+    }
+    if (end - p >= 4) {
+        uint32_t w;
+        memcpy(&w, p, 4);
+        h ^= (uint64_t)w * P1;
+        h = rotl64(h, 23) * P2 + P3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        h ^= *p * P5;
+        h = rotl64(h, 11) * P1;
+    }
+
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+}
+
+/* cachePath - entry file for a content hash */
+std::string cachePath(uint64_t key) {
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+    return std::string(cacheDir) + "/" + name;
+}
+
+/*****************************************************/
+/*
+cacheLookup - 1 if the entry for `key` says the input parses, 0 if it
+failed (diag gets the stored diagnostic, located in `name`), -1 on a
+miss. An entry is one small text file:
+    rdp-cache <PARSER_VERSION> <input length>
+    OK | ERR <line> <col>
+    <diagnostic without its Location line>
+*/
+int cacheLookup(uint64_t key, size_t len, const char* name, std::string& diag) {
+    STATS(stats.cacheLookups++);
+    int fd = open(cachePath(key).c_str(), O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    char buf[4096];
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0) {
+        return -1;
+    }
+    buf[n] = '\0';
+
+    unsigned version;
+    unsigned long long size, line, col;
+    int used = 0;
+    if (sscanf(buf, "rdp-cache %u %llu\n%n", &version, &size, &used) != 2 || used == 0
+        || version != PARSER_VERSION || size != len) {
+        return -1;
+    }
+    const char* rest = buf + used;
+    used = 0;
+    int hit;
+    if (strncmp(rest, "OK\n", 3) == 0) {
+        hit = 1;
+    } else if (sscanf(rest, "ERR %llu %llu\n%n", &line, &col, &used) == 2 && used != 0) {
+        diag.assign(rest + used);
+        diag += errorLocation(name, line, col);
+        hit = 0;
+    } else {
+        return -1;
+    }
+    STATS(stats.cacheHits++);
+    return hit;
+}
+
+/*****************************************************/
+/* cacheStore - write the entry for `key`; written to a temporary file
+   and renamed so concurrent runs never read half an entry. Failures
+   are ignored, the cache only saves work. */
+void cacheStore(uint64_t key, size_t len, bool ok, const std::string& body, uint64_t line, uint64_t col) {
+    std::string entry = "rdp-cache " + std::to_string(PARSER_VERSION) + " " + std::to_string(len) + "\n";
+    if (ok) {
+        entry += "OK\n";
+    } else {
+        entry += "ERR " + std::to_string(line) + " " + std::to_string(col) + "\n" + body;
+    }
+
+    mkdir(cacheDir, 0777);
+    std::string path = cachePath(key);
+    char tmp[64];
+    snprintf(tmp, sizeof(tmp), ".tmp.%d.%zx", (int)getpid(),
+             std::hash<std::thread::id>()(std::this_thread::get_id()));
+    std::string tmpPath = path + tmp;
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        return;
+    }
+    bool written = writeAll(fd, entry.data(), entry.size());
+    close(fd);
+    if (!written || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        unlink(tmpPath.c_str());
+    }
+}
+
+/*****************************************************/
+/* parseCached - parseBuffer() answered from the cache when --cache is set */
+bool parseCached(const char* buf, size_t len, const char* name, std::string& diag) {
+    if (cacheDir == NULL) {
+        return parseBuffer(buf, len, name, diag);
+    }
+    uint64_t key = hash64(buf, len, PARSER_VERSION);
+    int hit = cacheLookup(key, len, name, diag);
+    if (hit >= 0) {
+        return hit == 1;
+    }
+    uint64_t line, col;
+    bool ok = parseTrapped(buf, len, name, diag, line, col);
+    if (ok || line != 0) {
+        cacheStore(key, len, ok, diag, line, col);
+    }
+    if (!ok && line != 0) {
+        diag += errorLocation(name, line, col);
+    }
+    return ok;
+}
+
+/*****************************************************/
+/* astSymbol - intern the current IDENT token, returning its symbol index */
+uint32_t astSymbol() {
+    static thread_local std::string key;  // keeps its capacity
+    const char* p;
+    size_t n;
+    tokenText(p, n);
+    key.assign(p, n);
+    auto it = ast->symIndex.find(key);
+    if (it != ast->symIndex.end()) {
+        return it->second;
+    }
+    uint32_t sym = (uint32_t)ast->syms.size();
+    ast->syms.push_back(Sym{ (uint32_t)ast->names.size(), (uint32_t)n });
+    ast->names.append(p, n);
+    ast->symIndex.emplace(key, sym);
+    return sym;
+}
+
+/*****************************************************/
+/*
+astLeaf - factor() for an IDENT or INT_LIT token when building an AST:
+consume it and return its node. A literal's decimal value wraps modulo
+2^64 like the arithmetic; the digits of one past INT64_MAX are also
+kept for --exact. The streaming lexer has already converted it.
+*/
+uint32_t astLeaf() {
+    if (nextToken == IDENT) {
+        uint32_t sym = astSymbol();
+        advance();
+        return astPush(IDENT, sym, 0);
+    }
+    const char* p;
+    size_t n;
+    tokenText(p, n);
+    uint64_t v = (uint64_t)lexValue;
+    bool over = lexBig;
+    if (useTokens) {
+        over = decimalValue(p, n, sourceLen - (size_t)(p - source), v)
+               || v > (uint64_t)INT64_MAX;
+    }
+    uint32_t big = 0;
+    if (__builtin_expect(over, 0)) {
+        ast->bigLits.emplace_back(p, n);  // kept exact for --exact
+        big = (uint32_t)ast->bigLits.size();
+    }
+    ast->consts.push_back((int64_t)v);
+    advance();
+    return astPush(INT_LIT, (uint32_t)ast->consts.size() - 1, big);
+}
+
+static void astDivConst(Node& nd);
+
+/*****************************************************/
+/* astPush - append a node and return its index */
+uint32_t astPush(int op, uint32_t a, uint32_t b) {
+    Node nd = {};
+    nd.op = (uint8_t)op;
+    nd.a = a;
+    nd.b = b;
+    if (op == DIV_OP && divMagicOn) {
+        astDivConst(nd);
+    }
+    ast->nodes.push_back(nd);
+    return (uint32_t)ast->nodes.size() - 1;
+}
+
+/*****************************************************/
+/*
+divMagic - the multiplier and shift that divide by d >= 2 (Hacker's
+Delight 10-1, 64-bit): n / d == divConst(n, magic, shift) for every
+int64 n, negative ones and INT64_MIN included. False for d < 2: 0 must
+still fail at run time, and 1 and -1 stay ordinary divisions.
+*/
+bool divMagic(int64_t d, int64_t& magic, int& shift) {
+    if (d < 2) {
+        return false;
+    }
+    const uint64_t two63 = (uint64_t)1 << 63;
+    uint64_t ad = (uint64_t)d;
+    uint64_t anc = two63 - 1 - two63 % ad;  // largest n with n % d == d - 1
+    int p = 63;
+    uint64_t q1 = two63 / anc, r1 = two63 - q1 * anc;
+    uint64_t q2 = two63 / ad, r2 = two63 - q2 * ad;
+    uint64_t delta;
+    do {
+        p++;
+        q1 *= 2;
+        r1 *= 2;
+        if (r1 >= anc) {
+            q1++;
+            r1 -= anc;
+        }
+        q2 *= 2;
+        r2 *= 2;
+        if (r2 >= ad) {
+            q2++;
+            r2 -= ad;
+        }
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+    magic = (int64_t)(q2 + 1);
+    shift = p - 64;
+    return true;
+}
+
+/*****************************************************/
+/*
+astDivConst - strength reduction for a DIV_OP about to be added whose
+divisor is the literal just parsed: make it a DIV_CONST, with the
+magic multiplier stored right after the literal's constant, and drop
+the literal's node. A literal past INT64_MAX, 0 and 1 are left alone.
+*/
+static void astDivConst(Node& nd) {
+    const Node& lit = ast->nodes[nd.b];
+    if (nd.b + 1 != ast->nodes.size() || lit.op != INT_LIT || lit.b != 0
+        || lit.a + 1 != ast->consts.size()) {
+        return;
+    }
+    int64_t magic;
+    int shift;
+    if (!divMagic(ast->consts[lit.a], magic, shift)) {
+        return;
+    }
+    nd.op = DIV_CONST;
+    nd.shift = (uint8_t)shift;
+    nd.b = lit.a;
+    ast->consts.push_back(magic);
+    ast->nodes.pop_back();
+}
+
+/*****************************************************/
+/*
+astChainPush - astChainNode() when balancing: note the operands of a
+'+'/'-' or '*' chain instead of adding a node for each operator. term()
+ends the '*' chain at a '/', so it is never reassociated.
+*/
+uint32_t astChainPush(int op, uint32_t left, uint32_t right, size_t chain) {
+    if (op == DIV_OP) {
+        return astPush(DIV_OP, left, right);  // term() ended the chain at the '/'
+    }
+    if (chainTerms.size() == chain) {
+        chainTerms.push_back(ChainTerm{ left, false });
+    }
+    chainTerms.push_back(ChainTerm{ right, op == SUB_OP });
+    return left;
+}
+
+/*****************************************************/
+/* chainJoin - combine operands [from, to) of chainTerms with op
+   pairwise, a level at a time; returns the root (to > from) */
+static uint32_t chainJoin(int op, size_t from, size_t to) {
+    while (to - from > 1) {
+        size_t out = from;
+        for (size_t i = from; i + 1 < to; i += 2) {
+            chainTerms[out++].node = astPush(op, chainTerms[i].node, chainTerms[i + 1].node);
+        }
+        if ((to - from) & 1) {
+            chainTerms[out++] = chainTerms[to - 1];
+        }
+        to = out;
+    }
+    return chainTerms[from].node;
+}
+
+/*****************************************************/
+/*
+astChainJoin - tree-height reduction: add the nodes of the chain whose
+operands astChainPush() noted from `chain` on, as a balanced tree:
+(a+b)+(c+d) for a+b+c+d and (a+c)-(b+d) for a-b+c-d. The operations of
+one level do not depend on each other, so the evaluator can overlap
+them, and they follow all the operands' own nodes. Arithmetic wraps
+modulo 2^64 (and --exact is exact), so '+' and '*' are associative and
+the value is unchanged; every node is kept, so a division by zero
+still fails. A chain of fewer than 4 operands stays left-deep, as
+balancing it would not lower the tree. Returns the chain's root.
+*/
+uint32_t astChainJoin(int kind, uint32_t left, size_t chain) {
+    size_t to = chainTerms.size();
+    if (to == chain) {
+        return left;  // a single operand
+    }
+    if (to - chain < 4) {
+        left = chainTerms[chain].node;
+        for (size_t i = chain + 1; i < to; i++) {
+            int op = chainTerms[i].neg ? SUB_OP : kind;
+            left = astPush(op, left, chainTerms[i].node);
+        }
+        chainTerms.resize(chain);
+        return left;
+    }
+
+    // added operands first (the first one always is), then the subtracted ones
+    size_t neg = chain;
+    chainNeg.clear();
+    for (size_t i = chain; i < to; i++) {
+        if (chainTerms[i].neg) {
+            chainNeg.push_back(chainTerms[i]);
+        } else {
+            chainTerms[neg++] = chainTerms[i];
+        }
+    }
+    std::copy(chainNeg.begin(), chainNeg.end(), chainTerms.begin() + neg);
+    uint32_t root = chainJoin(kind, chain, neg);
+    if (neg < to) {
+        root = astPush(SUB_OP, root, chainJoin(ADD_OP, neg, to));
+    }
+    chainTerms.resize(chain);
+    return root;
+}
+
+/*****************************************************/
+/* tokenText - the current token's characters, in either input mode */
+void tokenText(const char*& p, size_t& n) {
+    if (useTokens) {
+        const Token& t = tokens[tokPos];
+        p = source + t.offset;
+        n = t.length;
+    } else {
+        p = lexeme;
+        n = (size_t)lexLen;
+    }
+}
+
+/*****************************************************/
+/* astProgram - Program view of a built AST */
+Program astProgram(const Ast& a) {
+    Program prog;
+    prog.nodes = a.nodes.data();
+    prog.nodeCount = (uint32_t)a.nodes.size();
+    prog.stmts = a.stmts.data();
+    prog.stmtCount = (uint32_t)a.stmts.size();
+    prog.consts = a.consts.data();
+    prog.constCount = (uint32_t)a.consts.size();
+    prog.syms = a.syms.data();
+    prog.symCount = (uint32_t)a.syms.size();
+    prog.names = a.names.data();
+    prog.nameBytes = (uint32_t)a.names.size();
+    return prog;
+}
+
+/*****************************************************/
+/*
+writeBinary - save a program in the binary format: header, symbols,
+names, constants, nodes, statements. Written to a temporary file and
+renamed into place.
+*/
+bool writeBinary(const Program& prog, const char* path) {
+    auto align = [](uint64_t off) { return (off + 7) & ~(uint64_t)7; };
+    BinHeader h = {};
+    memcpy(h.magic, "RDPB", 4);
+    h.version = BIN_VERSION;
+    h.symCount = prog.symCount;
+    h.nameBytes = prog.nameBytes;
+    h.constCount = prog.constCount;
+    h.nodeCount = prog.nodeCount;
+    h.stmtCount = prog.stmtCount;
+
+    uint64_t off = align(sizeof(BinHeader));
+    uint64_t symOff = off;
+    off = align(off + (uint64_t)prog.symCount * sizeof(Sym));
+    uint64_t nameOff = off;
+    off = align(off + prog.nameBytes);
+    uint64_t constOff = off;
+    off = align(off + (uint64_t)prog.constCount * sizeof(int64_t));
+    uint64_t nodeOff = off;
+    off = align(off + (uint64_t)prog.nodeCount * sizeof(Node));
+    uint64_t stmtOff = off;
+    off += (uint64_t)prog.stmtCount * sizeof(Stmt);
+    if (off > UINT32_MAX) {
+        return false;
+    }
+    h.symOff = (uint32_t)symOff;
+    h.nameOff = (uint32_t)nameOff;
+    h.constOff = (uint32_t)constOff;
+    h.nodeOff = (uint32_t)nodeOff;
+    h.stmtOff = (uint32_t)stmtOff;
+    h.size = off;
+
+    std::string img(off, '\0');
+    memcpy(&img[0], &h, sizeof(h));
+    memcpy(&img[symOff], prog.syms, (size_t)prog.symCount * sizeof(Sym));
+    memcpy(&img[nameOff], prog.names, prog.nameBytes);
+    memcpy(&img[constOff], prog.consts, (size_t)prog.constCount * sizeof(int64_t));
+    memcpy(&img[nodeOff], prog.nodes, (size_t)prog.nodeCount * sizeof(Node));
+    memcpy(&img[stmtOff], prog.stmts, (size_t)prog.stmtCount * sizeof(Stmt));
+
+    std::string tmpPath = std::string(path) + ".tmp." + std::to_string(getpid());
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        return false;
+    }
+    bool written = writeAll(fd, img.data(), img.size());
+    close(fd);
+    if (!written || rename(tmpPath.c_str(), path) != 0) {
+        unlink(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+/*****************************************************/
+/*
+loadBinary - map an emitted program and point `prog` into the mapping.
+Nothing is copied; the header is checked against the file size and
+verifyProgram() checks every index once, so evaluation can trust them.
+The mapping stays until unloadBinary(), which a failed load has
+already done.
+*/
+bool loadBinary(const char* path, Program& prog, std::string& why) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        why = "cannot open";
+        return false;
+    }
+    const char* data;
+    size_t len;
+    bool mapped = mapFile(fd, data, len);
+    close(fd);
+    if (!mapped) {
+        why = "cannot map";
+        return false;
+    }
+    prog = Program();
+    prog.map = data;
+    prog.mapLen = len;
+    auto fail = [&](const std::string& msg) {
+        why = msg;
+        unloadBinary(prog);
+        return false;
+    };
+
+    BinHeader h;
+    if (len < sizeof(h)) {
+        return fail("not a binary program");
+    }
+    memcpy(&h, data, sizeof(h));
+    if (memcmp(h.magic, "RDPB", 4) != 0) {
+        return fail("not a binary program");
+    }
+    if (h.version != BIN_VERSION) {
+        return fail("binary format version " + std::to_string(h.version) + ", expected "
+                    + std::to_string(BIN_VERSION));
+    }
+    auto fits = [&](uint32_t off, uint64_t bytes) {
+        return off % 8 == 0 && (uint64_t)off + bytes <= len;
+    };
+    if (h.size != len || !fits(h.symOff, (uint64_t)h.symCount * sizeof(Sym))
+        || !fits(h.nameOff, h.nameBytes)
+        || !fits(h.constOff, (uint64_t)h.constCount * sizeof(int64_t))
+        || !fits(h.nodeOff, (uint64_t)h.nodeCount * sizeof(Node))
+        || !fits(h.stmtOff, (uint64_t)h.stmtCount * sizeof(Stmt))) {
+        return fail("truncated or corrupt binary program");
+    }
+
+    prog.syms = (const Sym*)(data + h.symOff);
+    prog.symCount = h.symCount;
+    prog.names = data + h.nameOff;
+    prog.nameBytes = h.nameBytes;
+    prog.consts = (const int64_t*)(data + h.constOff);
+    prog.constCount = h.constCount;
+    prog.nodes = (const Node*)(data + h.nodeOff);
+    prog.nodeCount = h.nodeCount;
+    prog.stmts = (const Stmt*)(data + h.stmtOff);
+    prog.stmtCount = h.stmtCount;
+    if (!verifyProgram(prog, why)) {
+        return fail(why);
+    }
+    return true;
+}
+
+/*****************************************************/
+/* unloadBinary - release a program loadBinary() mapped; a no-op for
+   one viewing an Ast */
+void unloadBinary(Program& prog) {
+    if (prog.mapLen > 0) {
+        munmap((void*)prog.map, prog.mapLen);
+    }
+    prog = Program();
+}
+
+/*****************************************************/
+/* verifyProgram - check the invariants evalProgram() relies on: names,
+   constants and symbols in range, and each statement a run of nodes
+   whose operands lie earlier in the same run */
+bool verifyProgram(const Program& prog, std::string& why) {
+    why = "corrupt binary program";
+    for (uint32_t s = 0; s < prog.symCount; s++) {
+        if ((uint64_t)prog.syms[s].off + prog.syms[s].len > prog.nameBytes) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < prog.stmtCount; i++) {
+        const Stmt& st = prog.stmts[i];
+        if (st.target >= prog.symCount || st.first > st.root || st.root >= prog.nodeCount) {
+            return false;
+        }
+        for (uint32_t n = st.first; n <= st.root; n++) {
+            const Node& nd = prog.nodes[n];
+            switch (nd.op) {
+                case INT_LIT:
+                    if (nd.a >= prog.constCount) {
+                        return false;
+                    }
+                    break;
+                case IDENT:
+                    if (nd.a >= prog.symCount) {
+                        return false;
+                    }
+                    break;
+                case ADD_OP:
+                case SUB_OP:
+                case MULT_OP:
+                case DIV_OP:
+                    if (nd.a < st.first || nd.a >= n || nd.b < st.first || nd.b >= n) {
+                        return false;
+                    }
+                    break;
+                case DIV_CONST:
+                    // like a constant, the multiplier itself is taken on trust
+                    if (nd.a < st.first || nd.a >= n || (uint64_t)nd.b + 1 >= prog.constCount
+                        || nd.shift > 63) {
+                        return false;
+                    }
+                    break;
+                default:
+                    return false;
+            }
+        }
+    }
+    why.clear();
+    return true;
+}
+
+/*****************************************************/
+/*
+evalExpr - the value of the expression in nodes [first, root] on
+`vars`. Arithmetic wraps modulo 2^64 and division truncates toward
+zero; false on division by zero.
+*/
+static inline bool evalExpr(const Program& prog, uint32_t first, uint32_t root,
+                            const int64_t* vars, int64_t& out) {
+    static thread_local std::vector<int64_t> val;  // node values of one expression
+    val.resize(std::max<size_t>(val.size(), root - first + 1));
+    int64_t* v = val.data() - first;  // v[n] is node n's value
+    for (uint32_t n = first; n <= root; n++) {
+        const Node& nd = prog.nodes[n];
+        if (nd.op == INT_LIT) {
+            v[n] = prog.consts[nd.a];
+            continue;
+        }
+        if (nd.op == IDENT) {
+            v[n] = vars[nd.a];
+            continue;
+        }
+        if (nd.op == DIV_CONST) {
+            v[n] = divConst(v[nd.a], prog.consts[nd.b + 1], nd.shift);
+            continue;
+        }
+        uint64_t x = (uint64_t)v[nd.a], y = (uint64_t)v[nd.b];
+        switch (nd.op) {
+            case ADD_OP:  v[n] = (int64_t)(x + y); break;
+            case SUB_OP:  v[n] = (int64_t)(x - y); break;
+            case MULT_OP: v[n] = (int64_t)(x * y); break;
+            case DIV_OP:
+                if (y == 0) {
+                    return false;
+                }
+                // INT64_MIN / -1 overflows; it wraps like the other operators
+                v[n] = y == (uint64_t)-1 ? (int64_t)(0 - x) : (int64_t)x / (int64_t)y;
+                break;
+        }
+    }
+    out = v[root];
+    return true;
+}
+
+/*****************************************************/
+/* divZeroDiag - the runtime error for statement i dividing by zero,
+   numbered from statement `base` */
+static std::string divZeroDiag(const Program& prog, uint32_t i, uint32_t base = 0) {
+    const Sym& t = prog.syms[prog.stmts[i].target];
+    return "Runtime error: division by zero in statement " + std::to_string(i - base + 1)
+           + " (assignment to " + std::string(prog.names + t.off, t.len) + ")\n";
+}
+
+/*****************************************************/
+/*
+evalStatements - run statements [from, to) in order on `vars` (one
+64-bit value per symbol; unassigned variables read as 0). Dividing by
+zero stops with a runtime error in diag.
+*/
+bool evalStatements(const Program& prog, uint32_t from, uint32_t to,
+                    std::vector<int64_t>& vars, std::string& diag) {
+    vars.resize(prog.symCount, 0);
+    for (uint32_t i = from; i < to; i++) {
+        const Stmt& st = prog.stmts[i];
+        if (!evalExpr(prog, st.first, st.root, vars.data(), vars[st.target])) {
+            diag = divZeroDiag(prog, i);
+            return false;
+        }
+    }
+    return true;
+}
+
+/*****************************************************/
+/* evalProgram - run the whole program on `vars` */
+bool evalProgram(const Program& prog, std::vector<int64_t>& vars, std::string& diag) {
+    return evalStatements(prog, 0, prog.stmtCount, vars, diag);
+}
+
+/*****************************************************/
+/* formatValues - a "name = value" line for each assigned variable, in
+   order of first appearance */
+void formatValues(const Program& prog, const std::vector<int64_t>& vars, std::string& out) {
+    std::vector<bool> assigned(prog.symCount, false);
+    for (uint32_t i = 0; i < prog.stmtCount; i++) {
+        assigned[prog.stmts[i].target] = true;
+    }
+    for (uint32_t s = 0; s < prog.symCount; s++) {
+        if (assigned[s]) {
+            out.append(prog.names + prog.syms[s].off, prog.syms[s].len);
+            out += " = " + std::to_string(vars[s]) + "\n";
+        }
+    }
+}
+
+/*****************************************************/
+/* evalBegin/evalEnd - bracket an evaluation and its output as the
+   "eval" phase of --stats, --perf-counters and --trace */
+static Clock::time_point evalBegin() {
+    phaseBegin("eval");
+    return Clock::now();
+}
+
+static int evalEnd(Clock::time_point t0, int status) {
+    phaseEnd();
+    STATS(stats.eval += since(t0));
+    return status;
+}
+
+/*****************************************************/
+/* runProgram - --eval: evaluate, then print each assigned variable.
+   Returns the exit status. */
+int runProgram(const Program& prog) {
+    Clock::time_point t0 = evalBegin();
+    std::vector<int64_t> vars;
+    std::string diag;
+    bool ok;
+    if (vmOn) {
+        Bytecode bc;
+        std::string why;
+        if (!compileBytecode(prog, bc, why, vmPasses)) {
+            diag = "Runtime error: bad bytecode: " + why + "\n";
+            ok = false;
+        } else {
+            ok = runBytecode(prog, bc, vars, diag);
+        }
+    } else {
+        ok = evalProgram(prog, vars, diag);
+    }
+    if (!ok) {
+        std::cerr << diag;
+        return evalEnd(t0, 1);
+    }
+    std::string out;
+    formatValues(prog, vars, out);
+    fwrite(out.data(), 1, out.size(), stdout);
+    return evalEnd(t0, 0);
+}
+
+/*****************************************************/
+/* magTrim - drop leading zero limbs */
+static void magTrim(std::vector<uint32_t>& m) {
+    while (!m.empty() && m.back() == 0) {
+        m.pop_back();
+    }
+}
+
+/* magCmp - compare magnitudes: -1, 0 or 1 */
+static int magCmp(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b) {
+    if (a.size() != b.size()) {
+        return a.size() < b.size() ? -1 : 1;
+    }
+    for (size_t i = a.size(); i-- > 0; ) {
+        if (a[i] != b[i]) {
+            return a[i] < b[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+/* magAdd - r = a + b */
+static void magAdd(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b,
+                   std::vector<uint32_t>& r) {
+    const std::vector<uint32_t>& x = a.size() >= b.size() ? a : b;
+    const std::vector<uint32_t>& y = a.size() >= b.size() ? b : a;
+    r.assign(x.size() + 1, 0);
+    uint64_t carry = 0;
+    for (size_t i = 0; i < x.size(); i++) {
+        uint64_t t = (uint64_t)x[i] + (i < y.size() ? y[i] : 0) + carry;
+        r[i] = (uint32_t)t;
+        carry = t >> 32;
+    }
+    r[x.size()] = (uint32_t)carry;
+    magTrim(r);
+}
+
+/* magSub - r = a - b, for a >= b */
+static void magSub(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b,
+                   std::vector<uint32_t>& r) {
+    r.assign(a.size(), 0);
+    int64_t borrow = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        int64_t t = (int64_t)a[i] - (i < b.size() ? b[i] : 0) - borrow;
+        borrow = t < 0;
+        r[i] = (uint32_t)(t + (borrow << 32));
+    }
+    magTrim(r);
+}
+
+/* magMul - r = a * b, schoolbook */
+static void magMul(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b,
+                   std::vector<uint32_t>& r) {
+    r.assign(a.size() + b.size(), 0);
+    for (size_t i = 0; i < a.size(); i++) {
+        uint64_t carry = 0;
+        for (size_t j = 0; j < b.size(); j++) {
+            uint64_t t = (uint64_t)a[i] * b[j] + r[i + j] + carry;
+            r[i + j] = (uint32_t)t;
+            carry = t >> 32;
+        }
+        r[i + b.size()] = (uint32_t)carry;
+    }
+    magTrim(r);
+}
+
+/*****************************************************/
+/*
+magDiv - q = a / b (truncated), b nonzero: Knuth's algorithm D on
+32-bit limbs, as in Hacker's Delight (divmnu)
+*/
+static void magDiv(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b,
+                   std::vector<uint32_t>& q) {
+    q.clear();
+    if (magCmp(a, b) < 0) {
+        return;
+    }
+    size_t n = b.size(), m = a.size();
+    q.assign(m - n + 1, 0);
+    if (n == 1) {
+        uint64_t rem = 0;
+        for (size_t i = m; i-- > 0; ) {
+            uint64_t cur = (rem << 32) | a[i];
+            q[i] = (uint32_t)(cur / b[0]);
+            rem = cur % b[0];
+        }
+        magTrim(q);
+        return;
+    }
+    // normalize so the divisor's top limb has its high bit set
+    int s = __builtin_clz(b[n - 1]);
+    std::vector<uint32_t> vn(n), un(m + 1);
+    for (size_t i = n - 1; i > 0; i--) {
+        vn[i] = (b[i] << s) | (s ? (uint32_t)((uint64_t)b[i - 1] >> (32 - s)) : 0);
+    }
+    vn[0] = b[0] << s;
+    un[m] = s ? (uint32_t)((uint64_t)a[m - 1] >> (32 - s)) : 0;
+    for (size_t i = m - 1; i > 0; i--) {
+        un[i] = (a[i] << s) | (s ? (uint32_t)((uint64_t)a[i - 1] >> (32 - s)) : 0);
+    }
+    un[0] = a[0] << s;
+
+    const uint64_t base = 1ull << 32;
+    for (size_t j = m - n + 1; j-- > 0; ) {
+        uint64_t num = ((uint64_t)un[j + n] << 32) | un[j + n - 1];
+        uint64_t qhat = num / vn[n - 1], rhat = num % vn[n - 1];
+        while (qhat >= base || qhat * vn[n - 2] > ((rhat << 32) | un[j + n - 2])) {
+            qhat--;
+            rhat += vn[n - 1];
+            if (rhat >= base) {
+                break;
+            }
+        }
+        // un[j, j+n] -= qhat * vn
+        int64_t k = 0, t;
+        for (size_t i = 0; i < n; i++) {
+            uint64_t p = qhat * vn[i];
+            t = (int64_t)un[i + j] - k - (int64_t)(p & 0xffffffff);
+            un[i + j] = (uint32_t)t;
+            k = (int64_t)(p >> 32) - (t >> 32);
+        }
+        t = (int64_t)un[j + n] - k;
+        un[j + n] = (uint32_t)t;
+        q[j] = (uint32_t)qhat;
+        if (t < 0) { // qhat was one too large: add vn back
+            q[j]--;
+            uint64_t carry = 0;
+            for (size_t i = 0; i < n; i++) {
+                uint64_t u = (uint64_t)un[i + j] + vn[i] + carry;
+                un[i + j] = (uint32_t)u;
+                carry = u >> 32;
+            }
+            un[j + n] += (uint32_t)carry;
+        }
+    }
+    magTrim(q);
+}
+
+/*****************************************************/
+/* bigFromInt - a BigInt holding x */
+static BigInt bigFromInt(int64_t x) {
+    BigInt r;
+    r.neg = x < 0;
+    uint64_t m = r.neg ? 0 - (uint64_t)x : (uint64_t)x;
+    while (m != 0) {
+        r.mag.push_back((uint32_t)m);
+        m >>= 32;
+    }
+    return r;
+}
+
+/* bigFromDecimal - a BigInt from a run of decimal digits */
+static BigInt bigFromDecimal(const std::string& digits) {
+    BigInt r;
+    for (char c : digits) {
+        uint64_t carry = (uint64_t)(c - '0');
+        for (uint32_t& limb : r.mag) {
+            uint64_t t = (uint64_t)limb * 10 + carry;
+            limb = (uint32_t)t;
+            carry = t >> 32;
+        }
+        if (carry != 0) {
+            r.mag.push_back((uint32_t)carry);
+        }
+    }
+    return r;
+}
+
+/* bigToString - decimal text of a BigInt */
+static std::string bigToString(const BigInt& x) {
+    if (x.mag.empty()) {
+        return "0";
+    }
+    std::vector<uint32_t> m = x.mag;
+    std::string digits;
+    while (!m.empty()) {
+        uint64_t rem = 0;  // divide by 10^9, keep the remainder's 9 digits
+        for (size_t i = m.size(); i-- > 0; ) {
+            uint64_t cur = (rem << 32) | m[i];
+            m[i] = (uint32_t)(cur / 1000000000);
+            rem = cur % 1000000000;
+        }
+        magTrim(m);
+        for (int d = 0; d < 9 && (rem != 0 || !m.empty()); d++) {
+            digits += (char)('0' + rem % 10);
+            rem /= 10;
+        }
+    }
+    if (x.neg) {
+        digits += '-';
+    }
+    return std::string(digits.rbegin(), digits.rend());
+}
+
+/*****************************************************/
+// tagged values: odd words are 63-bit integers
+#define NUM_SMALL_MAX (INT64_MAX >> 1)
+#define NUM_SMALL_MIN (-NUM_SMALL_MAX - 1)
+
+static inline Num numSmall(int64_t x) {
+    return ((uint64_t)x << 1) | 1;
+}
+
+static inline bool numIsSmall(Num v) {
+    return v & 1;
+}
+
+static inline int64_t numValue(Num v) {
+    return (int64_t)v >> 1;  // arithmetic shift restores the sign
+}
+
+/* numBig - any value as a BigInt */
+static BigInt numBig(const ExactState& st, Num v) {
+    return numIsSmall(v) ? bigFromInt(numValue(v)) : st.bigs[v >> 1];
+}
+
+/* numFromBig - the tagged form of r: inline when it fits 63 bits */
+static Num numFromBig(ExactState& st, BigInt&& r) {
+    if (r.mag.empty()) {
+        return numSmall(0);
+    }
+    if (r.mag.size() <= 2) {
+        uint64_t m = r.mag[0] | (r.mag.size() > 1 ? (uint64_t)r.mag[1] << 32 : 0);
+        if (m <= (uint64_t)NUM_SMALL_MAX || (r.neg && m == (uint64_t)NUM_SMALL_MAX + 1)) {
+            return numSmall(r.neg ? (int64_t)(0 - m) : (int64_t)m);
+        }
+    }
+    st.bigs.push_back(std::move(r));
+    return (Num)(st.bigs.size() - 1) << 1;
+}
+
+/* bigAddSigned - x + y (subtract by flipping y's sign first) */
+static BigInt bigAddSigned(const BigInt& x, const BigInt& y) {
+    BigInt r;
+    if (x.neg == y.neg) {
+        magAdd(x.mag, y.mag, r.mag);
+        r.neg = x.neg;
+    } else if (magCmp(x.mag, y.mag) >= 0) {
+        magSub(x.mag, y.mag, r.mag);
+        r.neg = x.neg;
+    } else {
+        magSub(y.mag, x.mag, r.mag);
+        r.neg = y.neg;
+    }
+    r.neg = r.neg && !r.mag.empty();
+    return r;
+}
+
+/*****************************************************/
+/*
+numSlow - op on values that left the fast path (a bignum operand or a
+63-bit overflow); false on division by zero
+*/
+static bool numSlow(ExactState& st, int op, Num a, Num b, Num& out) {
+    BigInt x = numBig(st, a), y = numBig(st, b), r;
+    switch (op) {
+        case ADD_OP:
+            r = bigAddSigned(x, y);
+            break;
+        case SUB_OP:
+            y.neg = !y.neg && !y.mag.empty();
+            r = bigAddSigned(x, y);
+            break;
+        case MULT_OP:
+            magMul(x.mag, y.mag, r.mag);
+            r.neg = x.neg != y.neg && !r.mag.empty();
+            break;
+        case DIV_OP:
+            if (y.mag.empty()) {
+                return false;
+            }
+            magDiv(x.mag, y.mag, r.mag);  // truncates toward zero
+            r.neg = x.neg != y.neg && !r.mag.empty();
+            break;
+    }
+    out = numFromBig(st, std::move(r));
+    return true;
+}
+
+/*****************************************************/
+/*
+evalExact - --exact: run the program with exact integers. Operands
+that are both inline take the native path, with overflow checked on
+every + - * /; anything else goes through numSlow().
+*/
+bool evalExact(const Ast& a, ExactState& st, std::string& diag) {
+    std::vector<Num> val;
+    std::vector<Num> lits;  // big literals, converted once
+    st.vars.assign(a.syms.size(), numSmall(0));
+    for (const std::string& digits : a.bigLits) {
+        lits.push_back(numFromBig(st, bigFromDecimal(digits)));
+    }
+    for (uint32_t i = 0; i < a.stmts.size(); i++) {
+        const Stmt& s = a.stmts[i];
+        val.resize(std::max<size_t>(val.size(), s.root - s.first + 1));
+        Num* v = val.data() - s.first;
+        for (uint32_t n = s.first; n <= s.root; n++) {
+            const Node& nd = a.nodes[n];
+            if (nd.op == INT_LIT) {
+                int64_t c = a.consts[nd.a];
+                if (nd.b != 0) {
+                    v[n] = lits[nd.b - 1];
+                } else if (c <= NUM_SMALL_MAX) {
+                    v[n] = numSmall(c);
+                } else {
+                    v[n] = numFromBig(st, bigFromInt(c));
+                }
+                continue;
+            }
+            if (nd.op == IDENT) {
+                v[n] = st.vars[nd.a];
+                continue;
+            }
+            Num x = v[nd.a], y;
+            if (nd.op == DIV_CONST) {
+                int64_t d = a.consts[nd.b];  // >= 2, so p / d cannot overflow
+                if (__builtin_expect(numIsSmall(x), 1)) {
+                    v[n] = numSmall(numValue(x) / d);
+                    continue;
+                }
+                y = d <= NUM_SMALL_MAX ? numSmall(d) : numFromBig(st, bigFromInt(d));
+                numSlow(st, DIV_OP, x, y, v[n]);
+                continue;
+            }
+            y = v[nd.b];
+            if (__builtin_expect(numIsSmall(x & y), 1)) {
+                // on tagged words: (2p+1) - 1 + (2q+1) = 2(p+q) + 1, and a
+                // 64-bit overflow is exactly a 63-bit overflow of p+q
+                int64_t r;
+                bool ok;
+                switch (nd.op) {
+                    case ADD_OP:
+                        ok = !__builtin_add_overflow((int64_t)(x - 1), (int64_t)y, &r);
+                        break;
+                    case SUB_OP:
+                        ok = !__builtin_sub_overflow((int64_t)x, (int64_t)(y - 1), &r);
+                        break;
+                    case MULT_OP:
+                        // p * 2q is even, so adding the tag cannot overflow
+                        ok = !__builtin_mul_overflow(numValue(x), (int64_t)(y - 1), &r);
+                        r |= 1;
+                        break;
+                    default: { // DIV_OP
+                        int64_t p = numValue(x), q = numValue(y);
+                        ok = q != 0 && !(p == NUM_SMALL_MIN && q == -1);
+                        r = ok ? (int64_t)numSmall(p / q) : 0;
+                        break;
+                    }
+                }
+                if (ok) {
+                    v[n] = (Num)r;
+                    continue;
+                }
+            }
+            if (!numSlow(st, nd.op, x, y, v[n])) {
+                const Sym& t = a.syms[s.target];
+                diag = "Runtime error: division by zero in statement " + std::to_string(i + 1)
+                       + " (assignment to " + std::string(a.names.data() + t.off, t.len) + ")\n";
+                return false;
+            }
+        }
+        st.vars[s.target] = v[s.root];
+    }
+    return true;
+}
+
+/*****************************************************/
+/* formatExact - formatValues() for an exact run */
+void formatExact(const Ast& a, const ExactState& st, std::string& out) {
+    std::vector<bool> assigned(a.syms.size(), false);
+    for (const Stmt& s : a.stmts) {
+        assigned[s.target] = true;
+    }
+    for (size_t s = 0; s < a.syms.size(); s++) {
+        if (assigned[s]) {
+            Num v = st.vars[s];
+            out.append(a.names, a.syms[s].off, a.syms[s].len);
+            out += " = ";
+            out += numIsSmall(v) ? std::to_string(numValue(v)) : bigToString(st.bigs[v >> 1]);
+            out += "\n";
+        }
+    }
+}
+
+/*****************************************************/
+/* runExact - runProgram() with --exact */
+int runExact(const Ast& a) {
+    Clock::time_point t0 = evalBegin();
+    ExactState st;
+    std::string diag;
+    if (!evalExact(a, st, diag)) {
+        std::cerr << diag;
+        return evalEnd(t0, 1);
+    }
+    std::string out;
+    formatExact(a, st, out);
+    fwrite(out.data(), 1, out.size(), stdout);
+    return evalEnd(t0, 0);
+}
+
+// ---------- Bytecode VM (--vm) ----------
+/*****************************************************/
+/* bcName - printable name of a bytecode op */
+const char* bcName(int op) {
+    static const char* names[BC_OPS] = {
+        "CONST", "LOAD", "STORE", "ADD", "SUB", "MUL", "DIV", "DIVC",
+        "LOAD_LOAD_ADD", "LOAD_LOAD_SUB", "LOAD_LOAD_MUL", "LOAD_LOAD_DIV",
+        "ADD_LOAD", "SUB_LOAD", "MUL_LOAD", "DIV_LOAD",
+        "ADD_CONST", "SUB_CONST", "MUL_CONST", "LOAD_DIVC",
+        "ADD_STORE", "SUB_STORE", "MUL_STORE",
+    };
+    return op >= 0 && op < BC_OPS ? names[op] : "?";
+}
+
+static inline void bcEmit(Bytecode& bc, int op, uint32_t a, uint32_t b = 0, int shift = 0) {
+    Insn in = {};
+    in.op = (uint8_t)op;
+    in.shift = (uint8_t)shift;
+    in.a = a;
+    in.b = b;
+    bc.code.push_back(in);
+}
+
+/*****************************************************/
+/* bcArith - x X y for X = 0..3 (ADD, SUB, MUL, DIV), as evalExpr()
+   computes it; false on division by zero */
+static inline bool bcArith(int x_op, int64_t x, int64_t y, int64_t& out) {
+    switch (x_op) {
+        case 0:  out = (int64_t)((uint64_t)x + (uint64_t)y); return true;
+        case 1:  out = (int64_t)((uint64_t)x - (uint64_t)y); return true;
+        case 2:  out = (int64_t)((uint64_t)x * (uint64_t)y); return true;
+        default:
+            if (y == 0) {
+                return false;
+            }
+            out = y == -1 ? (int64_t)(0 - (uint64_t)x) : x / y;
+            return true;
+    }
+}
+
+/* bcConst - add a folded constant, returning its index */
+static uint32_t bcConst(Bytecode& bc, int64_t value) {
+    bc.consts.push_back(value);
+    return (uint32_t)(bc.consts.size() - 1);
+}
+
+/*****************************************************/
+/*
+peepholeBytecode - fold an operator on constants (CONST CONST op,
+CONST DIVC) into one CONST, unless it divides by zero, and drop a
+constant right operand that changes nothing (+0, -0, *1, /1). Then drop
+each statement whose store is never seen: `x = x`, and an assignment
+that cannot fail and is overwritten before x is read. A run that fails
+prints only its error, so the final values are all that matter.
+*/
+static void peepholeBytecode(Bytecode& bc) {
+    std::vector<Insn> out;
+    out.reserve(bc.code.size());
+    uint32_t from = 0;
+    for (uint32_t& to : bc.stmtEnd) {
+        size_t start = out.size();
+        for (uint32_t pc = from; pc < to; pc++) {
+            const Insn& in = bc.code[pc];
+            size_t n = out.size() - start;
+            if (n >= 1 && out.back().op == BC_CONST && in.op >= BC_ADD && in.op <= BC_DIV) {
+                int64_t y = bc.consts[out.back().a], r;
+                if (n >= 2 && out[out.size() - 2].op == BC_CONST) {
+                    if (bcArith(in.op - BC_ADD, bc.consts[out[out.size() - 2].a], y, r)) {
+                        out.pop_back();
+                        out.back().a = bcConst(bc, r);
+                        continue;
+                    }
+                } else if (y == (in.op <= BC_SUB ? 0 : 1)) {
+                    out.pop_back();
+                    continue;
+                }
+            } else if (n >= 1 && out.back().op == BC_CONST && in.op == BC_DIVC) {
+                out.back().a = bcConst(bc, divConst(bc.consts[out.back().a],
+                                                    bc.consts[in.a + 1], in.shift));
+                continue;
+            }
+            out.push_back(in);
+        }
+        from = to;
+        to = (uint32_t)out.size();
+    }
+
+    // dead stores, from the last statement back: dead[x] while the next
+    // access to x is a store
+    std::vector<uint8_t> dead(bc.symCount, 0), keep(bc.stmtEnd.size(), 1);
+    for (size_t i = bc.stmtEnd.size(); i-- > 0; ) {
+        uint32_t s = i > 0 ? bc.stmtEnd[i - 1] : 0, e = bc.stmtEnd[i];
+        uint32_t target = out[e - 1].a;
+        bool canFail = false;
+        for (uint32_t pc = s; pc < e; pc++) {
+            canFail |= out[pc].op == BC_DIV;
+        }
+        if ((dead[target] && !canFail)
+            || (e - s == 2 && out[s].op == BC_LOAD && out[s].a == target)) {
+            keep[i] = 0;
+            continue;
+        }
+        dead[target] = 1;
+        for (uint32_t pc = s; pc < e; pc++) {
+            if (out[pc].op == BC_LOAD) {
+                dead[out[pc].a] = 0;
+            }
+        }
+    }
+    bc.code.clear();
+    from = 0;
+    for (size_t i = 0; i < bc.stmtEnd.size(); i++) {
+        uint32_t to = bc.stmtEnd[i];
+        if (keep[i]) {
+            bc.code.insert(bc.code.end(), out.begin() + from, out.begin() + to);
+        }
+        bc.stmtEnd[i] = (uint32_t)bc.code.size();  // a dropped statement is empty
+        from = to;
+    }
+}
+
+/*****************************************************/
+/*
+fuseBytecode - replace the common sequences in each statement by one
+superinstruction, longest first, so a run dispatches fewer times.
+*/
+static void fuseBytecode(Bytecode& bc) {
+    std::vector<Insn> out;
+    out.reserve(bc.code.size());
+    uint32_t from = 0;
+    for (uint32_t& to : bc.stmtEnd) {
+        for (uint32_t pc = from; pc < to; ) {
+            const Insn* c = &bc.code[pc];
+            Insn in = c[0];
+            uint32_t used = 1;
+            int next = pc + 1 < to ? c[1].op : -1;
+            bool arith = next >= BC_ADD && next <= BC_DIV;
+            if (in.op == BC_LOAD && next == BC_LOAD && pc + 2 < to
+                && c[2].op >= BC_ADD && c[2].op <= BC_DIV) {
+                in.op = (uint8_t)(BC_LOAD_LOAD_X + c[2].op - BC_ADD);
+                in.b = c[1].a;
+                used = 3;
+            } else if (in.op == BC_LOAD && next == BC_DIVC) {
+                in.op = BC_LOAD_DIVC;
+                in.b = c[1].a;
+                in.shift = c[1].shift;
+                used = 2;
+            } else if (in.op == BC_LOAD && arith) {
+                in.op = (uint8_t)(BC_X_LOAD + next - BC_ADD);
+                used = 2;
+            } else if (in.op == BC_CONST && arith && next != BC_DIV) {
+                in.op = (uint8_t)(BC_X_CONST + next - BC_ADD);
+                used = 2;
+            } else if (in.op >= BC_ADD && in.op < BC_DIV && next == BC_STORE) {
+                in.op = (uint8_t)(BC_X_STORE + in.op - BC_ADD);
+                in.a = c[1].a;
+                used = 2;
+            }
+            out.push_back(in);
+            pc += used;
+        }
+        from = to;
+        to = (uint32_t)out.size();
+    }
+    bc.code.swap(out);
+}
+
+/*****************************************************/
+/*
+compileBytecode - stack code for a program, improved by the BC_* passes
+given, then verified. Nodes are in post-order
+but, once chains are balanced, not in stack order (all the operands of
+a chain come before its operators), so each expression is walked
+depth-first from its root, with an explicit stack as a left-deep
+chain can be as long as the statement.
+*/
+bool compileBytecode(const Program& prog, Bytecode& bc, std::string& why, int passes) {
+    static thread_local std::vector<std::pair<uint32_t, bool>> work;  // node, operands done
+    bc.code.clear();
+    bc.stmtEnd.clear();
+    bc.consts.assign(prog.consts, prog.consts + prog.constCount);
+    bc.symCount = prog.symCount;
+    for (uint32_t i = 0; i < prog.stmtCount; i++) {
+        const Stmt& st = prog.stmts[i];
+        work.clear();
+        work.emplace_back(st.root, false);
+        while (!work.empty()) {
+            uint32_t n = work.back().first;
+            bool done = work.back().second;
+            work.pop_back();
+            const Node& nd = prog.nodes[n];
+            switch (nd.op) {
+                case INT_LIT:   bcEmit(bc, BC_CONST, nd.a); continue;
+                case IDENT:     bcEmit(bc, BC_LOAD, nd.a);  continue;
+                case DIV_CONST:
+                    if (done) {
+                        bcEmit(bc, BC_DIVC, nd.b, 0, nd.shift);
+                    } else {
+                        work.emplace_back(n, true);
+                        work.emplace_back(nd.a, false);
+                    }
+                    continue;
+            }
+            if (done) {
+                bcEmit(bc, nd.op == ADD_OP ? BC_ADD : nd.op == SUB_OP ? BC_SUB
+                           : nd.op == MULT_OP ? BC_MUL : BC_DIV, 0);
+            } else {
+                work.emplace_back(n, true);
+                work.emplace_back(nd.b, false);
+                work.emplace_back(nd.a, false);
+            }
+        }
+        bcEmit(bc, BC_STORE, st.target);
+        bc.stmtEnd.push_back((uint32_t)bc.code.size());
+    }
+    if (passes & BC_PEEPHOLE) {
+        peepholeBytecode(bc);
+    }
+    if (passes & BC_FUSE) {
+        fuseBytecode(bc);
+    }
+    return verifyBytecode(bc, why);
+}
+
+/*****************************************************/
+/*
+verifyBytecode - check code once, so that runBytecode() needs no
+checks: every slot and constant index in range, no instruction pops
+more than its statement pushed, every statement leaves the stack empty,
+and statement ends in order. Sets maxStack, the deepest the stack gets.
+*/
+bool verifyBytecode(Bytecode& bc, std::string& why) {
+    bc.verified = false;
+    uint64_t nk = bc.consts.size();
+    uint32_t nv = bc.symCount, depth = 0, maxDepth = 0;
+    size_t end = bc.code.size(), s = 0;
+    if (bc.stmtEnd.empty() ? end != 0 : bc.stmtEnd.back() != end) {
+        why = "code does not end with a statement";
+        return false;
+    }
+    while (s < bc.stmtEnd.size() && bc.stmtEnd[s] == 0) {
+        s++;
+    }
+    for (size_t pc = 0; pc < end; pc++) {
+        const Insn& in = bc.code[pc];
+        uint32_t pops = 0, pushes = 1;
+        bool ok;
+        switch (in.op) {
+            case BC_CONST:      ok = in.a < nk; break;
+            case BC_LOAD:       ok = in.a < nv; break;
+            case BC_STORE:      ok = in.a < nv; pops = 1; pushes = 0; break;
+            case BC_ADD:
+            case BC_SUB:
+            case BC_MUL:
+            case BC_DIV:        ok = true; pops = 2; break;
+            case BC_DIVC:       ok = (uint64_t)in.a + 1 < nk && in.shift < 64; pops = 1; break;
+            case BC_LOAD_LOAD_X + 0:
+            case BC_LOAD_LOAD_X + 1:
+            case BC_LOAD_LOAD_X + 2:
+            case BC_LOAD_LOAD_X + 3:
+                ok = in.a < nv && in.b < nv;
+                break;
+            case BC_X_LOAD + 0:
+            case BC_X_LOAD + 1:
+            case BC_X_LOAD + 2:
+            case BC_X_LOAD + 3: ok = in.a < nv; pops = 1; break;
+            case BC_X_CONST + 0:
+            case BC_X_CONST + 1:
+            case BC_X_CONST + 2: ok = in.a < nk; pops = 1; break;
+            case BC_LOAD_DIVC:
+                ok = in.a < nv && (uint64_t)in.b + 1 < nk && in.shift < 64;
+                break;
+            case BC_X_STORE + 0:
+            case BC_X_STORE + 1:
+            case BC_X_STORE + 2: ok = in.a < nv; pops = 2; pushes = 0; break;
+            default:            ok = false; break;
+        }
+        if (!ok || depth < pops) {
+            why = "bad instruction " + std::string(bcName(in.op)) + " at " + std::to_string(pc);
+            return false;
+        }
+        depth += pushes - pops;
+        maxDepth = std::max(maxDepth, depth);
+        for (; s < bc.stmtEnd.size() && bc.stmtEnd[s] == pc + 1; s++) {
+            if (depth != 0) {
+                why = "statement " + std::to_string(s + 1) + " leaves values on the stack";
+                return false;
+            }
+        }
+    }
+    if (s != bc.stmtEnd.size()) {
+        why = "statement ends out of order";
+        return false;
+    }
+    bc.maxStack = maxDepth;
+    bc.verified = true;
+    return true;
+}
+
+/*****************************************************/
+/*
+runBytecode - run verified code on `vars` (one value per symbol), with
+the same arithmetic and errors as evalProgram(). Verification bounded
+every index and the stack depth, so no instruction checks them.
+*/
+bool runBytecode(const Program& prog, const Bytecode& bc, std::vector<int64_t>& vars,
+                 std::string& diag) {
+    static thread_local std::vector<int64_t> stackBuf;
+    if (!bc.verified) {
+        diag = "Runtime error: bytecode has not been verified\n";
+        return false;
+    }
+    if (stackBuf.size() < bc.maxStack) {
+        stackBuf.resize(bc.maxStack);
+    }
+    vars.resize(bc.symCount, 0);
+    int64_t* v = vars.data();
+    int64_t* stack = stackBuf.data();
+    const int64_t* k = bc.consts.data();
+    size_t sp = 0;  // stack[sp - 1] is the top
+    const Insn* code = bc.code.data();
+    size_t pc = 0, end = bc.code.size();
+
+    for (; pc < end; pc++) {
+        const Insn& in = code[pc];
+        switch (in.op) {
+            case BC_CONST:
+                stack[sp++] = k[in.a];
+                break;
+            case BC_LOAD:
+                stack[sp++] = v[in.a];
+                break;
+            case BC_STORE:
+                v[in.a] = stack[--sp];
+                break;
+            case BC_ADD:
+                sp--;
+                stack[sp - 1] = (int64_t)((uint64_t)stack[sp - 1] + (uint64_t)stack[sp]);
+                break;
+            case BC_SUB:
+                sp--;
+                stack[sp - 1] = (int64_t)((uint64_t)stack[sp - 1] - (uint64_t)stack[sp]);
+                break;
+            case BC_MUL:
+                sp--;
+                stack[sp - 1] = (int64_t)((uint64_t)stack[sp - 1] * (uint64_t)stack[sp]);
+                break;
+            case BC_DIV: {
+                int64_t y = stack[--sp], x = stack[sp - 1];
+                if (y == 0) {
+                    goto divZero;
+                }
+                stack[sp - 1] = y == -1 ? (int64_t)(0 - (uint64_t)x) : x / y;
+                break;
+            }
+            case BC_DIVC:
+                stack[sp - 1] = divConst(stack[sp - 1], k[in.a + 1], in.shift);
+                break;
+
+            // superinstructions
+            case BC_LOAD_LOAD_X + 0:
+            case BC_LOAD_LOAD_X + 1:
+            case BC_LOAD_LOAD_X + 2:
+            case BC_LOAD_LOAD_X + 3:
+                if (!bcArith(in.op - BC_LOAD_LOAD_X, v[in.a], v[in.b], stack[sp])) {
+                    goto divZero;
+                }
+                sp++;
+                break;
+            case BC_X_LOAD + 0:
+            case BC_X_LOAD + 1:
+            case BC_X_LOAD + 2:
+            case BC_X_LOAD + 3:
+                if (!bcArith(in.op - BC_X_LOAD, stack[sp - 1], v[in.a], stack[sp - 1])) {
+                    goto divZero;
+                }
+                break;
+            case BC_X_CONST + 0:
+            case BC_X_CONST + 1:
+            case BC_X_CONST + 2:
+                bcArith(in.op - BC_X_CONST, stack[sp - 1], k[in.a], stack[sp - 1]);
+                break;
+            case BC_LOAD_DIVC:
+                stack[sp++] = divConst(v[in.a], k[in.b + 1], in.shift);
+                break;
+            case BC_X_STORE + 0:
+            case BC_X_STORE + 1:
+            case BC_X_STORE + 2:
+                sp -= 2;
+                bcArith(in.op - BC_X_STORE, stack[sp], stack[sp + 1], v[in.a]);
+                break;
+            default:
+                __builtin_unreachable();  // verifyBytecode() accepts no other op
+        }
+    }
+    return true;
+
+divZero:
+    diag = divZeroDiag(prog, (uint32_t)(std::upper_bound(bc.stmtEnd.begin(), bc.stmtEnd.end(), pc)
+                                        - bc.stmtEnd.begin()));
+    return false;
+}
+
+/*****************************************************/
+/* docCheck - parse statement [s, e] (e its ';') on its own */
+static bool docCheck(size_t s, size_t e) {
+    tokPos = s - 1;
+    try {
+        advance();
+        statement();
+    } catch (const ParseFailed&) {
+        depth = 0;
+        return false;
+    }
+    return tokPos == e + 1;
+}
+
+/*****************************************************/
+/*
+docResult - the diagnostic program() would give for the whole text:
+a plain parse unless the text is "begin" followed by statements, else
+a sequential parse from the first failing statement (or from the
+tail after the last ';'), as parseParallel() resumes.
+*/
+static void docResult(Document& doc) {
+    size_t n = doc.semis.size();
+    size_t resume = 0;
+    if (n > 0 && doc.toks[0].kind == BEGIN) {
+        const uint8_t* bad = (const uint8_t*)memchr(doc.stmtState.data(), STMT_BAD, n);
+        size_t k = bad ? (size_t)(bad - doc.stmtState.data()) : n;
+        resume = k == 0 ? 1 : doc.semis[k - 1] + 1;
+    }
+
+    doc.ok = true;
+    doc.diag.clear();
+    doc.errMessage = NULL;
+    lineStarts.swap(doc.lines); // lend lineCol() the maintained index
+    try {
+        tokPos = resume - 1;
+        advance();
+        if (resume == 0) {
+            program();
+        } else {
+            if (resume == 1) {
+                statement_list();
+            } else {
+                while (nextToken == IDENT) {
+                    statement();
+                }
+            }
+            program_end();
+        }
+        if (nextToken != EOF) {
+            error("Unexpected symbols after end of program");
+        }
+    } catch (const ParseFailed& e) {
+        doc.ok = false;
+        doc.diag = formatError(e.message);
+        doc.errMessage = e.message;
+        doc.errOffset = tokens[tokPos].offset;
+        doc.errLength = tokens[tokPos].length;
+        depth = 0;
+    }
+    lineStarts.swap(doc.lines);
+}
+
+/*****************************************************/
+/* docOpen - lex a whole document, every statement left for docUpdate() */
+void docOpen(Document& doc, const char* name, const char* text, size_t len) {
+    doc.name = name;
+    doc.text.assign(text, len);
+    doc.toks.clear();
+    tokenize(doc.text.data(), 0, len, doc.toks, true);
+    doc.semis.clear();
+    for (size_t i = 0; i < doc.toks.size(); i++) {
+        if (doc.toks[i].kind == SEMICOLON) {
+            doc.semis.push_back((uint32_t)i);
+        }
+    }
+    doc.stmtState.assign(doc.semis.size(), STMT_UNCHECKED);
+    if (doc.keepAst) {
+        doc.ast = Ast();
+        doc.stmtAst.assign(doc.semis.size(), Stmt{});
+    }
+    doc.lines.assign(1, 0);
+    scanNewlines(doc.text.data(), len, [&](size_t i) {
+        doc.lines.push_back((uint32_t)(i + 1));
+    });
+}
+
+/*****************************************************/
+/* docUpdate - check every statement edited since the last update and
+   work out the document's result */
+void docUpdate(Document& doc) {
+    bool trapping = trapErrors;
+    const char* path = srcPath;
+    Ast* building = ast;
+    trapErrors = true;
+    useTokenArray(doc.text.data(), doc.text.size(), doc.toks);
+    srcPath = doc.name.c_str();
+    ast = doc.keepAst ? &doc.ast : NULL;
+
+    doc.reparsed = 0;
+    uint8_t* state = doc.stmtState.data();
+    size_t n = doc.stmtState.size();
+    for (uint8_t* p = state; (p = (uint8_t*)memchr(p, STMT_UNCHECKED, n - (p - state))) != NULL; p++) {
+        size_t k = (size_t)(p - state);
+        bool ok = doc.semis[k] > 0 && docCheck(k ? doc.semis[k - 1] + 1 : 1, doc.semis[k]);
+        *p = ok ? STMT_OK : STMT_BAD;
+        if (ok && ast) {
+            doc.stmtAst[k] = doc.ast.stmts.back();
+            doc.ast.stmts.clear();
+        }
+        doc.reparsed++;
+    }
+    ast = NULL;
+    docResult(doc);
+    ast = building;
+    srcPath = path;
+    trapErrors = trapping;
+}
+
+/*****************************************************/
+/*
+docAst - once docUpdate() has found the document ok, rebuild doc.ast
+from the statements' runs in order, dropping the nodes of replaced
+statements, so it is numbered as a parse of the whole text would
+number it: symbols in order of first appearance, then constants and
+nodes in statement order. doc.ast is then the program.
+*/
+void docAst(Document& doc) {
+    const Ast& in = doc.ast;
+    Ast out;
+    std::vector<uint32_t> symMap(in.syms.size(), UINT32_MAX);
+    auto symbol = [&](uint32_t s) {
+        if (symMap[s] == UINT32_MAX) {
+            std::string name = in.names.substr(in.syms[s].off, in.syms[s].len);
+            symMap[s] = (uint32_t)out.syms.size();
+            out.syms.push_back(Sym{ (uint32_t)out.names.size(), (uint32_t)name.size() });
+            out.names += name;
+            out.symIndex.emplace(name, symMap[s]);
+        }
+        return symMap[s];
+    };
+    for (Stmt& st : doc.stmtAst) {
+        uint32_t target = symbol(st.target);
+        uint32_t first = (uint32_t)out.nodes.size();
+        for (uint32_t i = st.first; i <= st.root; i++) {
+            Node nd = in.nodes[i];
+            if (nd.op == IDENT) {
+                nd.a = symbol(nd.a);
+            } else if (nd.op == INT_LIT) {
+                out.consts.push_back(in.consts[nd.a]);
+                nd.a = (uint32_t)out.consts.size() - 1;
+                if (nd.b != 0) {
+                    out.bigLits.push_back(in.bigLits[nd.b - 1]);
+                    nd.b = (uint32_t)out.bigLits.size();
+                }
+            } else if (nd.op == DIV_CONST) {
+                nd.a = nd.a - st.first + first;
+                out.consts.push_back(in.consts[nd.b]);      // divisor
+                out.consts.push_back(in.consts[nd.b + 1]);  // and magic
+                nd.b = (uint32_t)out.consts.size() - 2;
+            } else {
+                nd.a = nd.a - st.first + first;
+                nd.b = nd.b - st.first + first;
+            }
+            out.nodes.push_back(nd);
+        }
+        st = Stmt{ target, first, (uint32_t)out.nodes.size() - 1 };
+        out.stmts.push_back(st);
+    }
+    doc.ast = std::move(out);
+}
+
+/*****************************************************/
+/*
+docEdit - replace text[offset, offset + removed) with `ins` and bring
+the tokens up to date. No token spans a newline and a comment ends at
+one, so the lexer is in its default state at every line start: only
+the lines the edit touches are relexed, and the tokens before and
+after them are kept (shifted). The statements that overlap the relexed
+tokens, plus the one after them, are marked for docUpdate(); every
+other statement keeps its state. Several edits may be made before one
+docUpdate().
+*/
+void docEdit(Document& doc, size_t offset, size_t removed, const char* ins, size_t insLen) {
+    std::string& text = doc.text;
+    offset = std::min(offset, text.size());
+    removed = std::min(removed, text.size() - offset);
+
+    // old lines [lo, hi) contain the edit
+    size_t lo = offset == 0 ? 0 : text.rfind('\n', offset - 1) + 1; // npos + 1 == 0
+    size_t nl = text.find('\n', offset + removed);
+    size_t hi = nl == std::string::npos ? text.size() : nl + 1;
+    int64_t delta = (int64_t)insLen - (int64_t)removed;
+    text.replace(offset, removed, ins, insLen);
+
+    // old tokens [a, b) lie in those lines; lex their new text
+    auto byOffset = [](const Token& t, size_t off) { return t.offset < off; };
+    size_t a = std::lower_bound(doc.toks.begin(), doc.toks.end(), lo, byOffset) - doc.toks.begin();
+    size_t b = std::lower_bound(doc.toks.begin() + a, doc.toks.end(), hi, byOffset) - doc.toks.begin();
+    static thread_local std::vector<Token> fresh;
+    fresh.clear();
+    tokenize(text.data(), lo, (size_t)((int64_t)hi + delta), fresh, true);
+    fresh.pop_back(); // region end, not end of input
+
+    // splice tokens, shifting the ones after the edit (modulo 2^32 adds
+    // a negative delta too)
+    size_t m = fresh.size();
+    size_t rest = doc.toks.size() - b;
+    if (m > b - a) {
+        doc.toks.resize(a + m + rest);
+    }
+    Token* t = doc.toks.data();
+    memmove(t + a + m, t + b, rest * sizeof(Token));
+    memcpy(t + a, fresh.data(), m * sizeof(Token));
+    for (Token* p = t + a + m, *e = p + rest; p < e; p++) {
+        p->offset += (uint32_t)delta;
+    }
+    doc.toks.resize(a + m + rest);
+
+    // splice ';' positions and statement bits the same way; statements
+    // [oa, oa + fresh ';' count] are new or changed
+    size_t oa = std::lower_bound(doc.semis.begin(), doc.semis.end(), (uint32_t)a) - doc.semis.begin();
+    size_t ob = std::lower_bound(doc.semis.begin() + oa, doc.semis.end(), (uint32_t)b) - doc.semis.begin();
+    std::vector<uint32_t> newSemis;
+    for (size_t i = 0; i < m; i++) {
+        if (fresh[i].kind == SEMICOLON) {
+            newSemis.push_back((uint32_t)(a + i));
+        }
+    }
+    int64_t shift = (int64_t)m - (int64_t)(b - a);
+    for (size_t k = ob; k < doc.semis.size(); k++) {
+        doc.semis[k] = (uint32_t)((int64_t)doc.semis[k] + shift);
+    }
+    doc.semis.erase(doc.semis.begin() + oa, doc.semis.begin() + ob);
+    doc.semis.insert(doc.semis.begin() + oa, newSemis.begin(), newSemis.end());
+    doc.stmtState.erase(doc.stmtState.begin() + oa, doc.stmtState.begin() + ob);
+    doc.stmtState.insert(doc.stmtState.begin() + oa, newSemis.size(), STMT_UNCHECKED);
+    if (doc.keepAst) {
+        doc.stmtAst.erase(doc.stmtAst.begin() + oa, doc.stmtAst.begin() + ob);
+        doc.stmtAst.insert(doc.stmtAst.begin() + oa, newSemis.size(), Stmt{});
+    }
+    if (oa + newSemis.size() < doc.stmtState.size()) {
+        doc.stmtState[oa + newSemis.size()] = STMT_UNCHECKED;
+    }
+
+    // and line starts: those after a newline in [lo, hi) are replaced,
+    // later ones shift
+    size_t la = std::upper_bound(doc.lines.begin(), doc.lines.end(), (uint32_t)lo) - doc.lines.begin();
+    size_t lb = std::upper_bound(doc.lines.begin() + la, doc.lines.end(), (uint32_t)hi) - doc.lines.begin();
+    std::vector<uint32_t> newLines;
+    size_t newHi = (size_t)((int64_t)hi + delta);
+    for (size_t i = lo; i < newHi; i++) {
+        if (text[i] == '\n') {
+            newLines.push_back((uint32_t)(i + 1));
+        }
+    }
+    for (size_t k = lb; k < doc.lines.size(); k++) {
+        doc.lines[k] = (uint32_t)((int64_t)doc.lines[k] + delta);
+    }
+    doc.lines.erase(doc.lines.begin() + la, doc.lines.begin() + lb);
+    doc.lines.insert(doc.lines.begin() + la, newLines.begin(), newLines.end());
+}
+
+/*****************************************************/
+/* traceNow - ns since traceStart */
+uint64_t traceNow() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Clock::now() - traceStart).count();
+}
+
+/*****************************************************/
+/* traceThread - give the calling thread a ring buffer and a name */
+void traceThread(const char* name) {
+    if (!traceOn || traceBuf != NULL) {
+        return;
+    }
+    int slot = traceThreads.fetch_add(1);
+    if (slot >= TRACE_THREADS) {
+        return; // table full: this thread goes untraced
+    }
+    traceBuf = new TraceBuf();
+    traceBuf->thread = name;
+    traceBufs[slot] = traceBuf;
+}
+
+/*****************************************************/
+/* traceRecord - append span [ts, now) to this thread's ring */
+void traceRecord(const char* name, uint64_t ts, const char* arg) {
+    if (traceBuf == NULL) {
+        return;
+    }
+    uint64_t h = traceBuf->head.load(std::memory_order_relaxed);
+    TraceEvent& e = traceBuf->ev[h % TRACE_EVENTS];
+    e.name = name;
+    e.ts = ts;
+    e.dur = traceNow() - ts;
+    e.arg[0] = '\0';
+    if (arg != NULL) {
+        strncat(e.arg, arg, sizeof(e.arg) - 1);
+    }
+    traceBuf->head.store(h + 1, std::memory_order_release);
+}
+
+/*****************************************************/
+/* phaseBegin/phaseEnd - bracket a top-level phase for --perf-counters
+   and --trace */
+static const char* phaseName = NULL;
+static uint64_t    phaseTs = 0;
+
+void phaseBegin(const char* name) {
+    if (perfOn) {
+        perfBegin(name);
+    }
+    phaseName = name;
+    phaseTs = traceOn ? traceNow() : 0;
+}
+
+void phaseEnd() {
+    if (perfOn) {
+        perfEnd();
+    }
+    if (traceOn && phaseName != NULL) {
+        traceRecord(phaseName, phaseTs, NULL);
+    }
+    phaseName = NULL;
+}
+
+/*****************************************************/
+/* writeJsonString - s as a JSON string literal */
+static void writeJsonString(FILE* f, const char* s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            fprintf(f, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(f, "\\u%04x", c);
+        } else {
+            fputc(c, f);
+        }
+    }
+    fputc('"', f);
+}
+
+/*****************************************************/
+/* writeTrace - dump every thread's ring as trace-event JSON (atexit) */
+void writeTrace() {
+    phaseEnd(); // phase cut short by error()
+
+    FILE* f = fopen(tracePath, "w");
+    if (f == NULL) {
+        std::cerr << "ERROR - cannot write trace " << tracePath << "\n";
+        return;
+    }
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    bool first = true;
+    int threads = std::min(traceThreads.load(), TRACE_THREADS);
+    for (int t = 0; t < threads; t++) {
+        TraceBuf* b = traceBufs[t];
+        fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                   "\"args\":{\"name\":", first ? "" : ",\n", t + 1);
+        writeJsonString(f, b->thread);
+        fprintf(f, "}}");
+        first = false;
+
+        uint64_t head = b->head.load(std::memory_order_acquire);
+        uint64_t from = head > TRACE_EVENTS ? head - TRACE_EVENTS : 0;
+        for (uint64_t i = from; i < head; i++) {
+            const TraceEvent& e = b->ev[i % TRACE_EVENTS];
+            fprintf(f, ",\n{\"name\":");
+            writeJsonString(f, e.name);
+            fprintf(f, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+                    t + 1, e.ts / 1e3, e.dur / 1e3);
+            if (e.arg[0] != '\0') {
+                fprintf(f, ",\"args\":{\"file\":");
+                writeJsonString(f, e.arg);
+                fprintf(f, "}");
+            }
+            fprintf(f, "}");
+        }
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+}
+
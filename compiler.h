@@ -0,0 +1,544 @@
+/*
+  compiler.h - internal declarations shared by compiler.cpp (the lexer,
+  parser and evaluator built into libparser.a), the tool modes in
+  tools/ and main.cpp (the command-line client). Programs embedding
+  the parser use parser.h.
+*/
+
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <atomic>
+#include <chrono>
+
+// ---------- Globals ----------
+// lexer/parser state is per thread so slices can be parsed concurrently
+extern thread_local int  charClass;
+extern thread_local char lexeme[100];
+extern thread_local char nextChar;
+extern thread_local int  lexLen;
+extern thread_local int  nextToken;
+extern thread_local int64_t lexValue;  // INT_LIT from lex(): value modulo 2^64
+extern thread_local bool    lexBig;    // ... and it is past INT64_MAX
+extern FILE* in_fp;
+extern thread_local const char* srcPath;  // file name for diagnostics
+
+// ---------- Input buffer (streaming mode) ----------
+// getChar() reads through this fixed buffer, so streaming memory does
+// not grow with input size; only recursion depth (nesting) does
+#define IN_BUF_SIZE 65536
+extern unsigned char inBuf[IN_BUF_SIZE];
+extern size_t        inPos;
+extern size_t        inLen;
+extern uint64_t      inBase;  // byte offset of inBuf[0] in the input
+extern thread_local uint64_t tokStart;  // byte offset of the current token
+
+// pipes cannot be re-read for line numbers, so their newlines are
+// counted as each buffer is retired; files are rescanned on error only
+extern bool          inSeekable;
+extern uint64_t      inLines;  // newlines before inBuf (pipes)
+extern uint64_t      inLineStart;  // offset just past the last of them
+
+// deepest '(' nesting accepted; bounds parser stack use on any input
+#define MAX_DEPTH 10000
+extern thread_local int depth;
+
+// ---------- Token buffer (pre-lexed mode) ----------
+// One token in 8 bytes: kind:8 | length:24 | offset:32 (byte offset into source)
+struct Token {
+    int32_t  kind   : 8;
+    uint32_t length : 24;
+    uint32_t offset;
+};
+static_assert(sizeof(Token) == 8, "Token must stay 8 bytes");
+
+extern std::vector<Token> tokenBuf;  // main thread's token array
+extern int                lexJobs;  // --jobs=N: lexer threads
+
+// the parser's view of the pre-lexed input, per thread (see useTokenArray)
+extern thread_local bool         useTokens;
+extern thread_local const char*  source;  // whole input, pre-lexed mode only
+extern thread_local size_t       sourceLen;
+extern thread_local const Token* tokens;
+extern thread_local size_t       tokenCount;
+extern thread_local size_t       tokPos;  // index of current token (before first)
+extern thread_local std::vector<uint32_t> lineStarts;  // newline index of source, built by lineCol()
+extern int                parseJobs;  // --parse-jobs=N: statement parser threads
+extern int                benchTrials;  // --bench[=N]: timed runs per phase
+extern int                editTrials;  // --bench-edits[=N]: timed edits
+
+// ---------- Stats (--stats) ----------
+// Counters sit behind STATS(), a predicted-false branch on statsOn;
+// build with -DNO_STATS to compile them out entirely.
+#ifdef NO_STATS
+#define STATS(stmt) do { } while (0)
+#else
+#define STATS(stmt) do { if (__builtin_expect(statsOn, 0)) { stmt; } } while (0)
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+struct Stats {
+    Clock::time_point start;
+    double   open = 0, io = 0, lex = 0, parse = 0; // seconds
+    double   eval = 0;                             // seconds, --eval only
+    uint64_t tokenCount[128] = {};                 // by token code + 1 (EOF = 0)
+    std::atomic<uint64_t> commentBytes{0};
+    std::atomic<int>      maxDepth{0};             // deepest '(' nesting
+    double   hash = 0;                             // seconds, --cache only
+    std::atomic<uint64_t> cacheLookups{0}, cacheHits{0};
+};
+
+extern bool  statsOn;
+extern Stats stats;
+extern thread_local int maxDepthSeen;
+
+// ---------- Perf counters (--perf-counters) ----------
+// cycles, instructions, branch-misses, L1D read misses around each phase
+#define PERF_EVENTS 4
+#define PERF_PHASES 3   // lex, parse, eval
+
+struct PerfPhase {
+    const char* name;
+    uint64_t    count[PERF_EVENTS];    // start values until perfEnd()
+    uint64_t    bytes, tokens;
+};
+
+extern bool      perfOn;
+extern int       perfFd[PERF_EVENTS];
+extern int       perfErrno;  // why the first counter failed to open
+extern PerfPhase perfPhase[PERF_PHASES];
+extern int       perfPhases;
+extern int       perfActive;  // phase being counted, or -1
+
+// ---------- Trace (--trace=FILE) ----------
+// Chrome/Perfetto trace-event spans. Each thread appends to its own
+// fixed ring of events (oldest overwritten), registered once in a
+// fixed table, so recording takes no locks; writeTrace() dumps them
+// all as JSON at exit.
+#define TRACE_EVENTS  16384          // per thread
+#define TRACE_THREADS 256
+
+struct TraceEvent {
+    const char* name;                // string literal
+    uint64_t    ts, dur;             // ns since traceStart
+    char        arg[48];             // e.g. file name, truncated
+};
+
+struct TraceBuf {
+    const char*           thread;    // thread name for the viewer
+    std::atomic<uint64_t> head{0};   // events ever written
+    TraceEvent            ev[TRACE_EVENTS];
+};
+
+extern bool                  traceOn;
+extern const char*           tracePath;
+extern Clock::time_point     traceStart;
+extern TraceBuf*             traceBufs[TRACE_THREADS];
+extern std::atomic<int>      traceThreads;
+extern thread_local TraceBuf* traceBuf;
+
+// ---------- Result cache (--cache=DIR) ----------
+// One small file per input, named by XXH64 of its contents seeded with
+// PARSER_VERSION; bump the version whenever accepted syntax or the
+// diagnostic text changes so stale entries stop matching.
+#define PARSER_VERSION 1
+
+extern const char* cacheDir;
+
+// ---------- AST (--eval, --emit-binary) ----------
+// Built by the parser only when the thread's `ast` is set. A statement's
+// nodes are appended in post-order, so they form one contiguous run
+// ending at its root and every child precedes its parent: evaluating a
+// statement is a single forward pass over its run.
+struct Node {
+    uint8_t  op;           // INT_LIT, IDENT, ADD_OP, SUB_OP, MULT_OP, DIV_OP, DIV_CONST
+    uint8_t  shift;        // DIV_CONST: of the magic multiply
+    uint8_t  pad[2];
+    uint32_t a, b;         // operand nodes; INT_LIT: constant, IDENT: symbol
+};                         // (INT_LIT b: 1 + its bigLits index if past int64)
+
+// node a / literal d, d >= 2, as a multiply-high (see divMagic): b is
+// d's constant and the next constant is the magic multiplier
+#define DIV_CONST 40
+static_assert(sizeof(Node) == 12, "Node must stay 12 bytes");
+
+struct Stmt {
+    uint32_t target;       // symbol assigned
+    uint32_t first, root;  // node run [first, root]
+};
+
+struct Sym {
+    uint32_t off, len;     // name in the name area
+};
+
+struct Ast {
+    std::vector<Node>    nodes;
+    std::vector<Stmt>    stmts;
+    std::vector<int64_t> consts;
+    std::vector<Sym>     syms;
+    std::string          names;
+    std::unordered_map<std::string, uint32_t> symIndex;
+    std::vector<std::string> bigLits;  // digits of literals past INT64_MAX
+};
+
+// read-only view of a parsed program: an Ast, or a mapped binary file
+struct Program {
+    const Node*    nodes;  uint32_t nodeCount;
+    const Stmt*    stmts;  uint32_t stmtCount;
+    const int64_t* consts; uint32_t constCount;
+    const Sym*     syms;   uint32_t symCount;
+    const char*    names;  uint32_t nameBytes;
+    const char*    map = NULL;  size_t mapLen = 0;  // loadBinary()'s mapping
+};
+
+extern thread_local Ast* ast;
+extern bool        evalOn;  // --eval: run the program, print variables
+extern const char* emitPath;  // --emit-binary=FILE
+extern bool        loadBinaryOn;  // --load-binary: input is an emitted file
+extern bool        balanceOn;  // balance +/- and * chains (astChainJoin)
+extern bool        divMagicOn;  // divide by literals with DIV_CONST
+
+// an operand of a chain being parsed, see astChainPush
+struct ChainTerm {
+    uint32_t node;
+    bool     neg;          // subtracted
+};
+extern thread_local std::vector<ChainTerm> chainTerms;
+extern thread_local std::vector<ChainTerm> chainNeg;
+
+// ---------- Exact integers (--exact) ----------
+// With --exact, --eval computes exact values instead of wrapping. A
+// value is a tagged word: odd words hold a 63-bit integer (x << 1 | 1)
+// and stay on the native fast path; an operation that overflows 63
+// bits promotes to a BigInt, kept in ExactState::bigs and referred to
+// by an even word (index << 1). Results that fit are demoted again.
+typedef uint64_t Num;
+
+struct BigInt {
+    bool                  neg = false;
+    std::vector<uint32_t> mag;        // little-endian base 2^32, no leading 0s
+};
+
+struct ExactState {
+    std::vector<Num>    vars;         // one per symbol
+    std::vector<BigInt> bigs;         // every promoted value of the run
+};
+
+extern bool exactOn;
+
+// ---------- Bytecode VM (--vm) ----------
+// A program compiled for a stack machine: each statement pushes its
+// operands, applies its operators and stores the result. The code is
+// straight-line, so a run executes (dispatches) every instruction once.
+#define BC_CONST      0   // push consts[a]
+#define BC_LOAD       1   // push vars[a]
+#define BC_STORE      2   // pop into vars[a]
+#define BC_ADD        3
+#define BC_SUB        4
+#define BC_MUL        5
+#define BC_DIV        6   // fails on a zero divisor
+#define BC_DIVC       7   // top / consts[a], by consts[a + 1] and shift (DIV_CONST)
+#define BC_BASE_OPS   8
+// superinstructions, from the most frequent sequences --vm-profile found
+// in tests/a* and generated programs; X is ADD, SUB, MUL or DIV in the
+// order of BC_ADD..BC_DIV
+#define BC_LOAD_LOAD_X  8   // push vars[a] X vars[b]            LOAD LOAD X
+#define BC_X_LOAD      12   // top = top X vars[a]               LOAD X
+#define BC_X_CONST     16   // top = top X consts[a], not DIV    CONST X
+#define BC_LOAD_DIVC   19   // push vars[a] / consts[b]          LOAD DIVC
+#define BC_X_STORE     20   // pop two, store their X in vars[a], not DIV
+#define BC_OPS         23
+
+struct Insn {
+    uint8_t  op;           // BC_*
+    uint8_t  shift;        // BC_DIVC
+    uint8_t  pad[2];
+    uint32_t a, b;
+};
+
+struct Bytecode {
+    std::vector<Insn>     code;
+    std::vector<uint32_t> stmtEnd;     // code index past each statement
+    std::vector<int64_t>  consts;      // the program's, then folded ones
+    uint32_t              symCount = 0;
+    uint32_t              maxStack = 0;   // set by verifyBytecode()
+    bool                  verified = false;
+};
+
+// compileBytecode() passes
+#define BC_PEEPHOLE   1   // fold constants, drop dead and no-op stores
+#define BC_FUSE       2   // superinstructions
+#define BC_PASSES     3
+extern int vmPasses;     // BC_* passes for --vm (--no-peephole, --no-fuse)
+
+extern bool vmOn;        // --vm: --eval runs bytecode
+
+// ---------- Binary program format (--emit-binary, --load-binary) ----------
+// Pointer-free: each section is an array at an 8-byte aligned offset
+// from the start of the file, so a mapped file is used in place.
+// Bump BIN_VERSION whenever the layout or node meaning changes.
+#define BIN_VERSION 2
+
+struct BinHeader {
+    char     magic[4];                 // "RDPB"
+    uint32_t version;
+    uint64_t size;                     // whole file
+    uint32_t symCount, nameBytes, constCount, nodeCount, stmtCount;
+    uint32_t symOff, nameOff, constOff, nodeOff, stmtOff;
+};
+
+// ---------- Incremental documents ----------
+// A Document keeps its text, its tokens and a state for every
+// statement, so docEdit() relexes only the edited lines and docUpdate()
+// reparses only the statements they touched. Statement k is the token
+// run (semis[k-1], semis[k]], statement 0 starting just after "begin".
+// With keepAst set before docOpen(), each statement's nodes are also
+// kept as it is checked, and docAst() gathers them for evaluation.
+#define STMT_BAD       0
+#define STMT_OK        1
+#define STMT_UNCHECKED 2
+
+struct Document {
+    std::string           name;        // file name for diagnostics
+    std::string           text;
+    std::vector<Token>    toks;        // lexed past errors, ends with EOF
+    std::vector<uint32_t> semis;       // index in toks of every ';'
+    std::vector<uint8_t>  stmtState;   // STMT_*, one per ';'
+    std::vector<uint32_t> lines;       // line start offsets, for lineCol()
+    bool                  ok = false;  // result as of the last docUpdate()
+    std::string           diag;        // error() text when !ok
+    const char*           errMessage = NULL;
+    uint32_t              errOffset = 0, errLength = 0;
+    size_t                reparsed = 0; // statements checked by the last update
+    bool                  keepAst = false;
+    Ast                   ast;         // nodes of checked statements, stale ones too
+    std::vector<Stmt>     stmtAst;     // statement k's run in ast, when STMT_OK
+};
+
+// set on parser worker threads: error() throws ParseFailed instead of
+// exiting; formatError(message) gives the text error() would print
+struct ParseFailed {
+    const char* message;
+};
+extern thread_local bool trapErrors;
+
+// ---------- Character classes ----------
+#define LETTER  0
+#define DIGIT   1
+#define UNKNOWN 99
+
+// ---------- Token codes ----------
+#define INT_LIT     10
+#define IDENT       11
+#define ASSIGN_OP   20
+#define ADD_OP      21
+#define SUB_OP      22
+#define MULT_OP     23
+#define DIV_OP      24
+#define LEFT_PAREN  25
+#define RIGHT_PAREN 26
+#define UNDERSCORE  28
+#define END_PERIOD  29
+#define BEGIN       30
+#define END         31
+#define SEMICOLON   32
+
+// pre-lexed mode only: lexical errors are stored as tokens and reported
+// when the parser reaches them, same order as the streaming lexer
+#define LEX_ERR_UNDERSCORE 90
+#define LEX_ERR_TOO_LONG   91
+
+// ---------- Lexer declarations ----------
+void addChar();
+void getChar();
+bool fillInput();
+void lineCol(uint64_t offset, uint64_t& line, uint64_t& col);
+void getNonBlank();
+int  lex();
+int  lookup(char ch);
+bool decimalValue(const char* p, size_t n, size_t avail, uint64_t& v);
+size_t digitRun(const char* src, size_t i, size_t end);
+
+// ---------- Token buffer declarations ----------
+void tokenize(const char* src, size_t begin, size_t end, std::vector<Token>& out, bool whole = false);
+void tokenizeParallel(const char* src, size_t len, int jobs, std::vector<Token>& out);
+bool loadSource(FILE* fp);
+bool mapFile(int fd, const char*& data, size_t& len);
+void useTokenArray(const char* src, size_t len, const std::vector<Token>& toks);
+bool parseBuffer(const char* buf, size_t len, const char* name, std::string& diag);
+bool parseTrapped(const char* buf, size_t len, const char* name, std::string& body,
+                         uint64_t& line, uint64_t& col);
+int  advance();
+int  peek(size_t k);
+
+// ---------- Parser declarations ----------
+void program();
+void program_end();
+void statement_list();
+void statement();
+void assignment_statement();
+uint32_t expr();
+uint32_t term();
+uint32_t factor();
+uint32_t identifier();
+void parseParallel(int jobs);
+
+// ---------- Benchmark declarations ----------
+void bench(int trials);
+void benchEdits(int trials);
+int  vmProfile(const std::vector<const char*>& files);
+
+// ---------- Stats declarations ----------
+double since(Clock::time_point t0);
+void   countTokens(const std::vector<Token>& toks);
+void   printStats();
+
+// ---------- Perf counter declarations ----------
+void perfOpen();
+void perfBegin(const char* name);
+void perfEnd();
+void printPerf();
+
+// ---------- Daemon declarations ----------
+#define SERVE_MAX_LINE 8192                 // longest request line
+#define SERVE_MAX_SRC  ((size_t)256 << 20)  // largest SRC body
+
+// Conn - buffered reader over a socket or pipe (--serve, --lsp)
+struct Conn {
+    int    fd;
+    char   buf[4096];
+    size_t pos = 0, len = 0;
+
+    explicit Conn(int f) : fd(f) {}
+    bool fill();
+    bool line(std::string& out, size_t max);  // false at end of input or past max bytes
+    bool bytes(size_t n, std::string& out);
+    bool skip(size_t n);                      // discard n bytes
+};
+
+int serve(const char* sockPath, int threads);
+int client(const char* sockPath, const std::vector<const char*>& files, int repeat);
+
+// ---------- Cache declarations ----------
+bool     writeAll(int fd, const char* p, size_t n);  // retries short writes
+uint64_t hash64(const void* data, size_t len, uint64_t seed);
+std::string cachePath(uint64_t key);
+int      cacheLookup(uint64_t key, size_t len, const char* name, std::string& diag);
+void     cacheStore(uint64_t key, size_t len, bool ok, const std::string& body, uint64_t line, uint64_t col);
+bool     parseCached(const char* buf, size_t len, const char* name, std::string& diag);
+
+// ---------- AST / binary declarations ----------
+uint32_t astSymbol();
+uint32_t astLeaf();
+uint32_t astPush(int op, uint32_t a, uint32_t b);
+uint32_t astChainPush(int op, uint32_t left, uint32_t right, size_t chain);
+uint32_t astChainJoin(int kind, uint32_t left, size_t chain);
+bool     divMagic(int64_t d, int64_t& magic, int& shift);
+void     tokenText(const char*& p, size_t& n);
+Program  astProgram(const Ast& a);
+bool     writeBinary(const Program& prog, const char* path);
+bool     loadBinary(const char* path, Program& prog, std::string& why);
+void     unloadBinary(Program& prog);
+bool     verifyProgram(const Program& prog, std::string& why);
+bool     evalStatements(const Program& prog, uint32_t from, uint32_t to,
+                        std::vector<int64_t>& vars, std::string& diag);
+bool     evalProgram(const Program& prog, std::vector<int64_t>& vars, std::string& diag);
+void     formatValues(const Program& prog, const std::vector<int64_t>& vars, std::string& out);
+int      runProgram(const Program& prog);
+bool     evalExact(const Ast& a, ExactState& st, std::string& diag);
+void     formatExact(const Ast& a, const ExactState& st, std::string& out);
+int      runExact(const Ast& a);
+bool     compileBytecode(const Program& prog, Bytecode& bc, std::string& why,
+                         int passes = BC_PASSES);
+bool     verifyBytecode(Bytecode& bc, std::string& why);
+bool     runBytecode(const Program& prog, const Bytecode& bc, std::vector<int64_t>& vars,
+                     std::string& diag);
+const char* bcName(int op);
+
+// astNode - add a node when building an AST; the parser calls it for
+// every operand and operator, so the common no-AST case stays inline
+inline uint32_t astNode(int op, uint32_t a, uint32_t b) {
+    return __builtin_expect(ast != NULL, 0) ? astPush(op, a, b) : 0;
+}
+// astChainStart/Node/End - astNode for the operators of one expr() or
+// term() loop; when balancing, the chain's nodes are added at its end
+#define NO_CHAIN ((size_t)-1)
+inline size_t astChainStart() {
+    return __builtin_expect(ast != NULL, 0) && balanceOn ? chainTerms.size() : NO_CHAIN;
+}
+inline uint32_t astChainNode(int op, uint32_t left, uint32_t right, size_t chain) {
+    return __builtin_expect(chain == NO_CHAIN, 1) ? astNode(op, left, right)
+                                                  : astChainPush(op, left, right, chain);
+}
+inline uint32_t astChainEnd(int kind, uint32_t left, size_t chain) {
+    return __builtin_expect(chain == NO_CHAIN, 1) ? left : astChainJoin(kind, left, chain);
+}
+
+/* divConst - n / d for d's divMagic() multiplier and shift: the high
+   half of n * magic, corrected for a magic past INT64_MAX, shifted,
+   plus one for a negative n to truncate toward zero */
+static inline int64_t divConst(int64_t n, int64_t magic, int shift) {
+    uint64_t q = (uint64_t)(int64_t)(((__int128)magic * n) >> 64);
+    if (magic < 0) {
+        q += (uint64_t)n;
+    }
+    return ((int64_t)q >> shift) + (int64_t)((uint64_t)n >> 63);
+}
+
+// ---------- Incremental document declarations ----------
+void docOpen(Document& doc, const char* name, const char* text, size_t len);
+void docEdit(Document& doc, size_t offset, size_t removed, const char* ins, size_t insLen);
+void docUpdate(Document& doc);
+void docAst(Document& doc);
+
+// ---------- Language server declarations ----------
+#define LSP_DEBOUNCE_MS 10   // quiet time before diagnostics are published
+int lspServe();
+
+// ---------- Watch mode declarations ----------
+#define WATCH_SETTLE_MS    5    // quiet time that ends a burst of writes
+#define WATCH_MAX_DELAY_MS 100  // longest a change waits for its burst to end
+int watch(const char* dir);
+
+// ---------- REPL declarations ----------
+#define REPL_TIME_MIN 0.05  // seconds of repeated evaluation behind :time
+int repl();
+
+// ---------- Trace declarations ----------
+uint64_t traceNow();
+void     traceThread(const char* name);
+void     traceRecord(const char* name, uint64_t ts, const char* arg);
+void     writeTrace();
+void     phaseBegin(const char* name);
+void     phaseEnd();
+
+// TraceSpan - records [construction, destruction) as one span
+struct TraceSpan {
+    const char* name;
+    const char* arg;
+    uint64_t    ts;
+    TraceSpan(const char* n, const char* a = NULL) : name(n), arg(a), ts(traceOn ? traceNow() : 0) {}
+    ~TraceSpan() {
+        if (traceOn) {
+            traceRecord(name, ts, arg);
+        }
+    }
+};
+
+// ---------- error ----------
+std::string formatError(const char* message);
+std::string errorBody(const char* message, uint64_t& line, uint64_t& col);
+std::string errorLocation(const char* path, uint64_t line, uint64_t col);
+[[noreturn]] void error(const char* message);
+
+// ---------- Tool entry points ----------
+int runFile(const char* path);
+
+#endif
@@ -0,0 +1,469 @@
+/*
+  embed.h - compile-time front end for programs embedded as string literals
+
+  A constexpr copy of the lexer and of program()/expr()/term()/factor()
+  from compiler.cpp. An embedded program is parsed while the including
+  file compiles: a bad program is a compile error, and a good one is
+  turned into a template-specialized evaluator with one inlined
+  expression per statement, so nothing is parsed at run time. Long
+  chains and deep nesting cost no template depth; a parenthesis costs
+  the parse three constexpr calls, so nesting is bounded by the
+  compiler's constexpr depth (512 calls in GCC and Clang) before
+  embed::maxDepth.
+
+  Usage:
+    EMBED_PROGRAM(Calc, "begin a = 6; b = a * 7; end.");
+    int64_t vars[Embedded<Calc>::symbols] = {};   // unassigned read as 0
+    uint32_t failed = Embedded<Calc>::run(vars);  // statement that divided by 0, or 0
+    vars[Embedded<Calc>::slot("b")]               // 42
+
+  A syntax error stops the compile at a call to one of the functions in
+  EmbedSyntaxError, named after the message ./main would print, e.g.
+    error: call to non-'constexpr' function
+           'static void EmbedSyntaxError::right_parenthesis_expected()'
+  Evaluation follows --eval: arithmetic wraps modulo 2^64, division
+  truncates toward zero, and dividing by zero stops before the
+  statement's assignment.
+*/
+
+#ifndef EMBED_H
+#define EMBED_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+// ---------- Token codes (as in compiler.cpp) ----------
+// scoped, so including this header defines no macros
+namespace embed {
+enum : int {
+    INT_LIT     = 10,
+    IDENT       = 11,
+    ASSIGN_OP   = 20,
+    ADD_OP      = 21,
+    SUB_OP      = 22,
+    MULT_OP     = 23,
+    DIV_OP      = 24,
+    LEFT_PAREN  = 25,
+    RIGHT_PAREN = 26,
+    UNDERSCORE  = 28,
+    END_PERIOD  = 29,
+    BEGIN       = 30,
+    END         = 31,
+    SEMICOLON   = 32,
+};
+constexpr int endOfInput = -1;  // EOF in compiler.cpp
+constexpr int maxDepth = 10000;  // MAX_DEPTH in compiler.cpp
+}  // namespace embed
+
+/*****************************************************/
+/*
+EmbedSyntaxError - one function per parser diagnostic. They are not
+constexpr, so the parse calling one during constant evaluation is the
+compile error, and the function's name is its message. They are never
+called at run time.
+*/
+struct EmbedSyntaxError {
+    static void program_must_start_with_begin() {}
+    static void program_must_end_with_end() {}
+    static void missing_period_after_end() {}
+    static void unexpected_symbols_after_end_of_program() {}
+    static void assignment_operator_missing_in_assignment_statement() {}
+    static void semicolon_missing_at_end_of_assignment_statement() {}
+    static void expression_nested_too_deeply() {}
+    static void right_parenthesis_expected() {}
+    static void expected_identifier_number_or_left_paren_in_factor() {}
+    static void identifier_must_start_with_letter() {}
+    static void consecutive_underscores_not_allowed_in_identifier() {}
+    static void lexeme_is_too_long() {}
+    static void no_such_variable() {}
+};
+
+// ---------- AST ----------
+// the flat post-order layout of compiler.cpp: each statement's nodes
+// are contiguous, children before parents
+struct EmbedNode {
+    uint8_t  op;
+    uint32_t a, b;  // operands; constant or symbol index for leaves
+};
+
+struct EmbedStmt {
+    uint32_t target, first, root;
+};
+
+/* EmbedAst - a parsed program; N bounds every count (the text's size) */
+template <size_t N>
+struct EmbedAst {
+    EmbedNode nodes[N] = {};
+    EmbedStmt stmts[N] = {};
+    int64_t   consts[N] = {};
+    uint32_t  symOff[N] = {};  // symbol names, as offsets into the text
+    uint32_t  symLen[N] = {};
+    uint32_t  nodeCount = 0, stmtCount = 0, constCount = 0, symCount = 0;
+};
+
+/*****************************************************/
+/*
+EmbedParser - the recursive descent parser over a NUL-terminated text
+of N - 1 characters, streaming one token of lookahead like lex()
+*/
+template <size_t N>
+class EmbedParser {
+  public:
+    constexpr explicit EmbedParser(const char* text) : src(text) {}
+
+    constexpr EmbedAst<N> parse() {
+        advance();
+        program();
+        if (nextToken != embed::endOfInput) {
+            EmbedSyntaxError::unexpected_symbols_after_end_of_program();
+        }
+        return out;
+    }
+
+  private:
+    const char* src;
+    size_t      pos = 0;
+    int         nextToken = 0;
+    size_t      tokStart = 0, tokLen = 0;
+    int         depth = 0;
+    EmbedAst<N> out;
+
+    static constexpr bool isLetter(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+    static constexpr bool isDigit(char c) { return c >= '0' && c <= '9'; }
+    static constexpr bool isSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+    }
+
+    /* advance - lex the next token, as tokenize() does */
+    constexpr void advance() {
+        for (;;) {
+            while (isSpace(src[pos])) {
+                pos++;
+            }
+            if (src[pos] != '~') {
+                break;
+            }
+            while (src[pos] != '\0' && src[pos] != '\n') { // comment runs to end of line
+                pos++;
+            }
+        }
+        tokStart = pos;
+        char c = src[pos];
+        if (c == '\0') {
+            nextToken = embed::endOfInput;
+            tokLen = 0;
+            return;
+        }
+        if (isLetter(c)) {
+            nextToken = embed::IDENT;
+            pos++;
+            for (;;) {
+                if (isLetter(src[pos]) || isDigit(src[pos])) {
+                    pos++;
+                } else if (src[pos] == '_') {
+                    pos++;
+                    if (src[pos] == '_') {
+                        EmbedSyntaxError::consecutive_underscores_not_allowed_in_identifier();
+                    }
+                } else {
+                    break;
+                }
+            }
+            if (textIs(tokStart, pos - tokStart, "begin")) {
+                nextToken = embed::BEGIN;
+            } else if (textIs(tokStart, pos - tokStart, "end")) {
+                nextToken = embed::END;
+            }
+        } else if (isDigit(c)) {
+            nextToken = embed::INT_LIT;
+            while (isDigit(src[pos])) {
+                pos++;
+            }
+        } else {
+            switch (c) {
+                case '(': nextToken = embed::LEFT_PAREN;  break;
+                case ')': nextToken = embed::RIGHT_PAREN; break;
+                case '+': nextToken = embed::ADD_OP;      break;
+                case '-': nextToken = embed::SUB_OP;      break;
+                case '*': nextToken = embed::MULT_OP;     break;
+                case '/': nextToken = embed::DIV_OP;      break;
+                case '_': nextToken = embed::UNDERSCORE;  break;
+                case '.': nextToken = embed::END_PERIOD;  break;
+                case ';': nextToken = embed::SEMICOLON;   break;
+                case '=': nextToken = embed::ASSIGN_OP;   break;
+                default:  nextToken = embed::endOfInput; break;  // unknown character
+            }
+            pos++;
+        }
+        tokLen = pos - tokStart;
+        if (tokLen > 99) {
+            EmbedSyntaxError::lexeme_is_too_long();
+        }
+    }
+
+    /* textIs - whether text[off, off + len) spells word */
+    constexpr bool textIs(size_t off, size_t len, const char* word) const {
+        for (size_t i = 0; i < len; i++) {
+            if (word[i] != src[off + i]) {
+                return false;
+            }
+        }
+        return word[len] == '\0';
+    }
+
+    /* symbol - intern the current IDENT, in order of first appearance */
+    constexpr uint32_t symbol() {
+        for (uint32_t s = 0; s < out.symCount; s++) {
+            if (out.symLen[s] == tokLen) {
+                size_t i = 0;
+                while (i < tokLen && src[out.symOff[s] + i] == src[tokStart + i]) {
+                    i++;
+                }
+                if (i == tokLen) {
+                    return s;
+                }
+            }
+        }
+        out.symOff[out.symCount] = (uint32_t)tokStart;
+        out.symLen[out.symCount] = (uint32_t)tokLen;
+        return out.symCount++;
+    }
+
+    constexpr uint32_t push(int op, uint32_t a, uint32_t b) {
+        out.nodes[out.nodeCount] = EmbedNode{ (uint8_t)op, a, b };
+        return out.nodeCount++;
+    }
+
+    /* program = "begin", statement_list, "end", "." ; */
+    constexpr void program() {
+        if (nextToken != embed::BEGIN) {
+            EmbedSyntaxError::program_must_start_with_begin();
+        }
+        advance();
+        statement_list();
+        if (nextToken != embed::END) {
+            EmbedSyntaxError::program_must_end_with_end();
+        }
+        advance();
+        if (nextToken != embed::END_PERIOD) {
+            EmbedSyntaxError::missing_period_after_end();
+        }
+        advance();
+    }
+
+    /* statement_list = statement, { statement } ; */
+    constexpr void statement_list() {
+        assignment_statement();
+        while (nextToken == embed::IDENT) {
+            assignment_statement();
+        }
+    }
+
+    /* assignment_statement = identifier, "=", expr, ";" ; */
+    constexpr void assignment_statement() {
+        uint32_t target = identifier();
+        if (nextToken != embed::ASSIGN_OP) {
+            EmbedSyntaxError::assignment_operator_missing_in_assignment_statement();
+        }
+        advance();
+        uint32_t first = out.nodeCount;
+        uint32_t root = expr();
+        if (nextToken != embed::SEMICOLON) {
+            EmbedSyntaxError::semicolon_missing_at_end_of_assignment_statement();
+        }
+        advance();
+        out.stmts[out.stmtCount++] = EmbedStmt{ target, first, root };
+    }
+
+    /* expr = term, { ("+" | "-"), term } ; */
+    constexpr uint32_t expr() {
+        uint32_t left = term();
+        while (nextToken == embed::ADD_OP || nextToken == embed::SUB_OP) {
+            int op = nextToken;
+            advance();
+            uint32_t right = term();
+            left = push(op, left, right);
+        }
+        return left;
+    }
+
+    /* term = factor, { ("*" | "/"), factor } ; */
+    constexpr uint32_t term() {
+        uint32_t left = factor();
+        while (nextToken == embed::MULT_OP || nextToken == embed::DIV_OP) {
+            int op = nextToken;
+            advance();
+            uint32_t right = factor();
+            left = push(op, left, right);
+        }
+        return left;
+    }
+
+    /* factor = identifier | number | "(", expr, ")" ; */
+    constexpr uint32_t factor() {
+        if (nextToken == embed::IDENT) {
+            uint32_t sym = symbol();
+            advance();
+            return push(embed::IDENT, sym, 0);
+        }
+        if (nextToken == embed::INT_LIT) {
+            uint64_t v = 0;  // wraps modulo 2^64 like the arithmetic
+            for (size_t i = 0; i < tokLen; i++) {
+                v = v * 10 + (uint64_t)(src[tokStart + i] - '0');
+            }
+            out.consts[out.constCount] = (int64_t)v;
+            advance();
+            return push(embed::INT_LIT, out.constCount++, 0);
+        }
+        if (nextToken == embed::LEFT_PAREN) {
+            if (++depth > embed::maxDepth) {
+                EmbedSyntaxError::expression_nested_too_deeply();
+            }
+            advance();
+            uint32_t inner = expr();
+            depth--;
+            if (nextToken != embed::RIGHT_PAREN) {
+                EmbedSyntaxError::right_parenthesis_expected();
+            }
+            advance();
+            return inner;
+        }
+        EmbedSyntaxError::expected_identifier_number_or_left_paren_in_factor();
+        return 0;
+    }
+
+    /* identifier - the target of an assignment_statement */
+    constexpr uint32_t identifier() {
+        if (nextToken != embed::IDENT) {
+            EmbedSyntaxError::identifier_must_start_with_letter();
+        }
+        uint32_t sym = symbol();
+        advance();
+        return sym;
+    }
+};
+
+/*****************************************************/
+/*
+EmbedEval - statement Stmt of program A as inlined code. Its nodes are
+in post-order, so a pack expansion over their indices computes them in
+order, each into a local slot from the slots of its operands,
+specialized on the node's operator: the statement becomes straight-line
+code. Nothing recurses, so the template depth is the same for any chain
+length or nesting; ok is cleared by a division by zero.
+*/
+template <class A, uint32_t Stmt>
+struct EmbedEval {
+    static constexpr uint32_t first = A::ast.stmts[Stmt].first;
+    static constexpr uint32_t count = A::ast.stmts[Stmt].root - first + 1;
+
+    static inline int64_t run(const int64_t* vars, bool& ok) {
+        return runNodes(vars, ok, std::make_index_sequence<count>());
+    }
+
+  private:
+    template <size_t... I>
+    static inline int64_t runNodes(const int64_t* vars, bool& ok, std::index_sequence<I...>) {
+        int64_t v[count];  // v[i] is node first + i; the root is last
+        // a braced list runs in order like a comma fold, but GCC takes
+        // time quadratic in the length of a fold
+        int order[] = { (v[I] = node<first + I>(v, vars, ok), 0)... };
+        (void)order;
+        return v[count - 1];
+    }
+
+    template <uint32_t Node>
+    static inline int64_t node(const int64_t* v, const int64_t* vars, bool& ok) {
+        constexpr EmbedNode nd = A::ast.nodes[Node];
+        if constexpr (nd.op == embed::INT_LIT) {
+            return A::ast.consts[nd.a];
+        } else if constexpr (nd.op == embed::IDENT) {
+            return vars[nd.a];
+        } else {
+            int64_t x = v[nd.a - first], y = v[nd.b - first];
+            if constexpr (nd.op == embed::ADD_OP) {
+                return (int64_t)((uint64_t)x + (uint64_t)y);
+            } else if constexpr (nd.op == embed::SUB_OP) {
+                return (int64_t)((uint64_t)x - (uint64_t)y);
+            } else if constexpr (nd.op == embed::MULT_OP) {
+                return (int64_t)((uint64_t)x * (uint64_t)y);
+            } else {
+                if (y == 0) {
+                    ok = false;
+                    return 0;
+                }
+                // INT64_MIN / -1 overflows; it wraps like the other operators
+                return y == -1 ? (int64_t)(0 - (uint64_t)x) : x / y;
+            }
+        }
+    }
+};
+
+/*****************************************************/
+/*
+Embedded - the compiled form of an EMBED_PROGRAM: its AST, parsed at
+compile time, and run(), which executes the statements in order
+*/
+template <class P>
+struct Embedded {
+    static constexpr size_t size = sizeof(P::text);
+    static constexpr EmbedAst<size> ast = EmbedParser<size>(P::text).parse();
+    static constexpr uint32_t symbols = ast.symCount;
+    static constexpr uint32_t statements = ast.stmtCount;
+
+    /* slot - the vars[] index of a variable; a compile error if the
+       program has none of that name and slot() is constant-evaluated */
+    static constexpr uint32_t slot(const char* name) {
+        for (uint32_t s = 0; s < symbols; s++) {
+            uint32_t i = 0;
+            while (i < ast.symLen[s] && name[i] == P::text[ast.symOff[s] + i]) {
+                i++;
+            }
+            if (i == ast.symLen[s] && name[i] == '\0') {
+                return s;
+            }
+        }
+        EmbedSyntaxError::no_such_variable();
+        return symbols;
+    }
+
+    /* name - a variable's name (not NUL-terminated) and its length */
+    static constexpr const char* name(uint32_t s, size_t& len) {
+        len = ast.symLen[s];
+        return P::text + ast.symOff[s];
+    }
+
+    /* run - execute the program on vars[symbols]. Returns 0, or the
+       1-based number of the statement that divided by zero (earlier
+       statements keep their assignments). */
+    static uint32_t run(int64_t* vars) {
+        return runAll(vars, std::make_index_sequence<statements>());
+    }
+
+  private:
+    template <size_t I>
+    static inline bool step(int64_t* vars) {
+        bool ok = true;
+        int64_t v = EmbedEval<Embedded, I>::run(vars, ok);
+        if (ok) {
+            vars[ast.stmts[I].target] = v;
+        }
+        return ok;
+    }
+
+    template <size_t... I>
+    static inline uint32_t runAll(int64_t* vars, std::index_sequence<I...>) {
+        uint32_t failed = 0;
+        (void)((step<I>(vars) || (failed = (uint32_t)I + 1, false)) && ...);
+        return failed;
+    }
+};
+
+/* EMBED_PROGRAM - declare Name as an embedded program for Embedded<Name> */
+#define EMBED_PROGRAM(Name, literal) \
+    struct Name {                    \
+        static constexpr char text[] = literal; \
+    }
+
+#endif
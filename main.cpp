@@ -0,0 +1,153 @@
+/*
+  main - command-line client of libparser.a
+
+  Parses options and hands off to a tool mode in tools/: runFile() for
+  a single file, or one of the long-running modes (--serve, --client,
+  --lsp, --watch, --repl). All lexing, parsing and evaluation live in
+  compiler.cpp; see parser.h for the in-memory API other programs use.
+*/
+
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <thread>
+
+#include "compiler.h"
+
+int main(int argc, char* argv[]) {
+    std::vector<const char*> files;
+    const char* servePath = NULL;
+    const char* clientPath = NULL;
+    bool lspOn = false;
+    bool replOn = false;
+    bool profileOn = false;
+    const char* watchDir = NULL;
+    int repeat = 1;
+    bool badArg = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--tokens") == 0) {
+            useTokens = true;
+        } else if (strncmp(argv[i], "--jobs=", 7) == 0 && atoi(argv[i] + 7) > 0) {
+            lexJobs = atoi(argv[i] + 7);
+            useTokens = true;
+        } else if (strncmp(argv[i], "--parse-jobs=", 13) == 0 && atoi(argv[i] + 13) > 0) {
+            parseJobs = atoi(argv[i] + 13);
+            useTokens = true;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            statsOn = true;
+        } else if (strcmp(argv[i], "--perf-counters") == 0) {
+            perfOn = true;
+        } else if (strncmp(argv[i], "--trace=", 8) == 0 && argv[i][8] != '\0') {
+            traceOn = true;
+            tracePath = argv[i] + 8;
+        } else if (strcmp(argv[i], "--bench") == 0) {
+            benchTrials = 5;
+            useTokens = true;
+        } else if (strncmp(argv[i], "--bench=", 8) == 0 && atoi(argv[i] + 8) > 0) {
+            benchTrials = atoi(argv[i] + 8);
+            useTokens = true;
+        } else if (strcmp(argv[i], "--bench-edits") == 0) {
+            editTrials = 1000;
+            useTokens = true;
+        } else if (strncmp(argv[i], "--bench-edits=", 14) == 0 && atoi(argv[i] + 14) > 0) {
+            editTrials = atoi(argv[i] + 14);
+            useTokens = true;
+        } else if (strncmp(argv[i], "--watch=", 8) == 0 && argv[i][8] != '\0') {
+            watchDir = argv[i] + 8;
+        } else if (strcmp(argv[i], "--repl") == 0) {
+            replOn = true;
+        } else if (strcmp(argv[i], "--lsp") == 0) {
+            lspOn = true;
+        } else if (strncmp(argv[i], "--serve=", 8) == 0 && argv[i][8] != '\0') {
+            servePath = argv[i] + 8;
+        } else if (strncmp(argv[i], "--client=", 9) == 0 && argv[i][9] != '\0') {
+            clientPath = argv[i] + 9;
+        } else if (strncmp(argv[i], "--cache=", 8) == 0 && argv[i][8] != '\0') {
+            cacheDir = argv[i] + 8;
+            useTokens = true;
+        } else if (strcmp(argv[i], "--eval") == 0) {
+            evalOn = true;
+        } else if (strncmp(argv[i], "--emit-binary=", 14) == 0 && argv[i][14] != '\0') {
+            emitPath = argv[i] + 14;
+        } else if (strcmp(argv[i], "--no-balance") == 0) {
+            balanceOn = false;
+        } else if (strcmp(argv[i], "--no-div-magic") == 0) {
+            divMagicOn = false;
+        } else if (strcmp(argv[i], "--vm") == 0) {
+            vmOn = true;
+        } else if (strcmp(argv[i], "--no-peephole") == 0) {
+            vmPasses &= ~BC_PEEPHOLE;
+        } else if (strcmp(argv[i], "--no-fuse") == 0) {
+            vmPasses &= ~BC_FUSE;
+        } else if (strcmp(argv[i], "--vm-profile") == 0) {
+            profileOn = true;
+        } else if (strcmp(argv[i], "--exact") == 0) {
+            exactOn = true;
+        } else if (strcmp(argv[i], "--load-binary") == 0) {
+            loadBinaryOn = true;
+        } else if (strncmp(argv[i], "--repeat=", 9) == 0 && atoi(argv[i] + 9) > 0) {
+            repeat = atoi(argv[i] + 9);
+        } else if (argv[i][0] == '-' && argv[i][1] == '-') {
+            badArg = true;
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+    bool daemon = servePath != NULL || clientPath != NULL || lspOn || watchDir != NULL || replOn
+                  || profileOn;
+    bool noFiles = servePath != NULL || lspOn || watchDir != NULL || replOn;
+    if (badArg || (noFiles && !files.empty()) || (!noFiles && files.empty())
+        || (!daemon && files.size() != 1) || (exactOn && (!evalOn || loadBinaryOn || vmOn))) {
+        std::cerr << "Usage: " << argv[0] << " [--tokens] [--jobs=N] [--parse-jobs=N] [--bench[=N]]\n"
+                  << "       " << std::string(strlen(argv[0]), ' ')
+                  << " [--bench-edits[=N]] [--cache=DIR] [--eval [--exact | --vm]] [--emit-binary=FILE]\n"
+                  << "       " << std::string(strlen(argv[0]), ' ')
+                  << " [--no-balance] [--no-div-magic] [--no-peephole] [--no-fuse]\n"
+                  << "       " << std::string(strlen(argv[0]), ' ')
+                  << " [--stats] [--perf-counters]\n"
+                  << "       " << std::string(strlen(argv[0]), ' ')
+                  << " [--trace=FILE] <source_file | ->\n"
+                  << "       " << argv[0] << " --load-binary [--eval [--vm]] <binary_file>\n"
+                  << "       " << argv[0] << " --serve=SOCKET [--jobs=N] [--cache=DIR]\n"
+                  << "       " << argv[0] << " --client=SOCKET [--repeat=N] <source_file | ->...\n"
+                  << "       " << argv[0] << " --lsp [--stats]\n"
+                  << "       " << argv[0] << " --watch=DIR [--eval [--exact]]\n"
+                  << "       " << argv[0] << " --repl [--no-peephole] [--no-fuse]\n"
+                  << "       " << argv[0] << " --vm-profile <source_file>...\n";
+        return 1;
+    }
+
+    if (statsOn) {
+        stats.start = Clock::now();
+        atexit(printStats); // also runs when error() exits
+    }
+    if (perfOn) {
+        perfOpen();
+        atexit(printPerf);
+    }
+    if (traceOn) {
+        traceStart = Clock::now();
+        traceThread("main");
+        atexit(writeTrace);
+    }
+    if (servePath != NULL) {
+        return serve(servePath, lexJobs > 1 ? lexJobs : (int)std::thread::hardware_concurrency());
+    }
+    if (clientPath != NULL) {
+        return client(clientPath, files, repeat);
+    }
+    if (lspOn) {
+        return lspServe();
+    }
+    if (watchDir != NULL) {
+        return watch(watchDir);
+    }
+    if (replOn) {
+        return repl();
+    }
+    if (profileOn) {
+        return vmProfile(files);
+    }
+
+    return runFile(files[0]);
+}
@@ -0,0 +1,43 @@
+/*
+  parser.h - in-memory API of libparser.a
+
+  Checks (and optionally evaluates) a program held in memory, with the
+  same results and diagnostics as ./main, without starting a process:
+
+    #include "parser.h"
+
+    ParseResult r = parse(text, len);
+    if (!r.ok) {
+        fputs(r.diag.c_str(), stderr);   // Error: ... Location: <buffer>:3:22
+    }
+
+  Link with libparser.a and -pthread. parse() may be called from any
+  number of threads at once: parser state is per thread, and each
+  thread's token array and AST storage are kept between calls, so a
+  warm thread checking a valid program allocates nothing.
+*/
+
+#ifndef PARSER_H
+#define PARSER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+struct ParseOptions {
+    const char* name = "<buffer>";  // file name in the Location line
+    bool        eval = false;       // also run the program, as --eval does
+    bool        exact = false;      // with eval: exact integers, as --exact
+};
+
+struct ParseResult {
+    bool        ok = false;
+    std::string diag;               // why not: syntax error text as ./main prints
+                                    // it, or the --eval runtime error
+    uint64_t    line = 0, col = 0;  // of the syntax error; 0 otherwise
+    std::string output;             // with eval: "name = value" lines, as --eval
+};
+
+ParseResult parse(const char* buf, size_t len, const ParseOptions& opts = ParseOptions());
+
+#endif
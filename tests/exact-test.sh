@@ -0,0 +1,94 @@
+#!/bin/sh
+# Differential test of --exact: every program must print the same
+# values, errors and exit status under "main --eval --exact" as under
+# exactcheck, a decimal reference evaluator. Programs are every
+# operator on operands at 2^62, 2^63 and 2^64 (each +-1, both signs,
+# where 63-bit values promote to BigInts and results demote), the
+# divisions that take Knuth's add-back step, and generated ones with
+# long literals. Usage: tests/exact-test.sh [./main] [./exactcheck] [./gen] [seeds]
+MAIN=${1:-./main}
+CHECK=${2:-./exactcheck}
+GEN=${3:-./gen}
+SEEDS=${4:-100}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+fail() {
+    echo "exact-test: $1"
+    exit 1
+}
+
+# check FILE WHAT - compare --eval --exact with the reference
+check() {
+    "$MAIN" --eval --exact "$1" > "$DIR/got" 2>&1
+    got=$?
+    "$CHECK" "$1" > "$DIR/want" 2>&1
+    want=$?
+    if [ $got != $want ] || ! cmp -s "$DIR/want" "$DIR/got"; then
+        diff "$DIR/want" "$DIR/got" | head -n 20
+        fail "$2 differs from the reference"
+    fi
+    COUNT=$((COUNT + 1))
+}
+COUNT=0
+
+# every pair of boundary operands, each operator, both signs
+VALUES="1 3 7 4294967296
+4611686018427387903 4611686018427387904 4611686018427387905
+9223372036854775807 9223372036854775808 9223372036854775809
+18446744073709551615 18446744073709551616 18446744073709551617
+79228162514264337593543950335 340282366920938463463374607431768211457"
+N=0
+{
+    echo begin
+    for x in $VALUES; do
+        for y in $VALUES; do
+            for a in "$x" "(0 - $x)"; do
+                for b in "$y" "(0 - $y)"; do
+                    for op in + - '*' /; do
+                        N=$((N + 1))
+                        echo "r$N = $a $op $b;"
+                    done
+                done
+            done
+        done
+        # promote, then demote back through the same path
+        N=$((N + 1))
+        echo "r$N = $x * $x / $x - $x + 1;"
+        N=$((N + 1))
+        echo "r$N = (0 - $x) * 2 / 2 + $x;"
+    done
+    echo end.
+} > "$DIR/bounds.txt"
+check "$DIR/bounds.txt" "the boundary program"
+
+# Knuth D: the first quotient digit above the base and the add-back
+# step, from Hacker's Delight's divmnu tests; positive and negative
+cat > "$DIR/knuth.txt" <<'EOF'
+begin
+q0 = 604462910088780974129152 / 140737488420863;
+q1 = 39614081257132168796771975171 / 9903520314283042199192993793;
+q2 = 604462909807314587353091 / 151115727451828646838273;
+q3 = 2596069201709362459734969208012800 / 604462909807314587353089;
+q4 = 2596148429267413814546714551386112 / 604462909807314587418623;
+q5 = 170141183460469231750134047781003722752 / 39614081257132168796772040703;
+q6 = 170141183460469231750134047781003722752 / 39614081257132168801066942463;
+n1 = (0 - 39614081257132168796771975171) / 9903520314283042199192993793;
+n3 = 2596069201709362459734969208012800 / (0 - 604462909807314587353089);
+n6 = (0 - 170141183460469231750134047781003722752) / (0 - 39614081257132168801066942463);
+t1 = (0 - 39614081257132168796771975170) / 9903520314283042199192993793;
+end.
+EOF
+check "$DIR/knuth.txt" "the Knuth D program"
+
+s=1
+while [ $s -le "$SEEDS" ]; do
+    for opts in "--vars=3 --digits=20 --factors=3" \
+                "--vars=3 --digits=20 --factors=3 --safe-div" \
+                "--vars=5 --literals=0.6 --digits=40 --terms=6 --depth=3"; do
+        "$GEN" --statements=12 --seed=$s $opts > "$DIR/gen.txt" || fail "$GEN failed"
+        check "$DIR/gen.txt" "gen --statements=12 --seed=$s $opts"
+    done
+    s=$((s + 1))
+done
+echo "exact-test: ok ($COUNT programs)"
@@ -0,0 +1,48 @@
+#!/bin/sh
+# Scripted LSP session against "main --lsp": open tests/a3 (missing ')'),
+# check the diagnostic, type the ')' in two edits, check that it clears,
+# then shut down; also send a header with an oversized length.
+# Usage: tests/lsp-client.sh [./main]
+MAIN=${1:-./main}
+OUT=$(mktemp)
+trap 'rm -f "$OUT"' EXIT
+
+msg() {
+    printf 'Content-Length: %d\r\n\r\n%s' "${#1}" "$1"
+}
+
+URI=file:///a3
+TEXT=$(sed 's/$/\\n/' tests/a3 | tr -d '\n')
+
+{
+    msg '{"jsonrpc":"2.0","id":1,"method":"initialize","params":{"capabilities":{}}}'
+    msg '{"jsonrpc":"2.0","method":"initialized","params":{}}'
+    msg '{"jsonrpc":"2.0","method":"textDocument/didOpen","params":{"textDocument":{"uri":"'$URI'","languageId":"rdp","version":1,"text":"'"$TEXT"'"}}}'
+    sleep 0.3
+    msg '{"jsonrpc":"2.0","method":"textDocument/didChange","params":{"textDocument":{"uri":"'$URI'","version":2},"contentChanges":[{"range":{"start":{"line":3,"character":22},"end":{"line":3,"character":22}},"text":" "}]}}'
+    msg '{"jsonrpc":"2.0","method":"textDocument/didChange","params":{"textDocument":{"uri":"'$URI'","version":3},"contentChanges":[{"range":{"start":{"line":3,"character":22},"end":{"line":3,"character":23}},"text":")"}]}}'
+    sleep 0.3
+    msg '{"jsonrpc":"2.0","id":2,"method":"shutdown"}'
+    msg '{"jsonrpc":"2.0","method":"exit"}'
+} | "$MAIN" --lsp > "$OUT"
+STATUS=$?
+
+fail() {
+    echo "lsp-client: $1"
+    tr '\r' '\n' < "$OUT"
+    exit 1
+}
+
+[ $STATUS -eq 0 ] || fail "exit status $STATUS"
+grep -q '"id":1,"result":{"capabilities"' "$OUT" || fail "no initialize result"
+grep -q '"start":{"line":3,"character":22}.*"message":"Right parenthesis' "$OUT" \
+    || fail "no diagnostic for the missing ')'"
+# the two edits arrive together, so they are checked and published once
+[ "$(grep -o publishDiagnostics "$OUT" | wc -l)" -eq 2 ] || fail "edits were not debounced"
+grep -q '"diagnostics":\[\]' "$OUT" || fail "diagnostic not cleared after the fix"
+grep -q '"id":2,"result":null' "$OUT" || fail "no shutdown result"
+
+# an oversized message is refused before its body is read
+printf 'Content-Length: 999999999999\r\n\r\n' | "$MAIN" --lsp > "$OUT"
+grep -q '"code":-32600' "$OUT" || fail "oversized message not refused"
+echo "lsp-client: ok"
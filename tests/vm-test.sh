@@ -0,0 +1,64 @@
+#!/bin/sh
+# Differential test of the bytecode VM: every program must print the
+# same values, errors and exit status under "main --eval --vm", with
+# each combination of its passes, as under "main --eval". Programs are
+# a few fixed cases for the peephole rules plus generated ones; most
+# generated programs divide by a variable that is still 0, often in a
+# statement whose store is dead. Usage: tests/vm-test.sh [./main] [./gen] [seeds]
+MAIN=${1:-./main}
+GEN=${2:-./gen}
+SEEDS=${3:-100}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+fail() {
+    echo "vm-test: $1"
+    exit 1
+}
+
+# check FILE - compare --eval with every --vm pass setting
+check() {
+    "$MAIN" --eval "$1" > "$DIR/want" 2>&1
+    want=$?
+    for passes in "--no-peephole --no-fuse" "--no-peephole" "--no-fuse" ""; do
+        "$MAIN" --eval --vm $passes "$1" > "$DIR/got" 2>&1
+        got=$?
+        if [ $got != $want ] || ! cmp -s "$DIR/want" "$DIR/got"; then
+            cat "$1"
+            diff "$DIR/want" "$DIR/got"
+            fail "the program above differs with --vm $passes"
+        fi
+    done
+    COUNT=$((COUNT + 1))
+}
+
+COUNT=0
+N=0
+while read -r body; do
+    N=$((N + 1))
+    printf 'begin\n%s\nend.\n' "$body" > "$DIR/fixed$N.txt"
+    check "$DIR/fixed$N.txt"
+done <<'EOF'
+a = 2 * 3 + 7 / 2 - 10 / 3; b = a + 0; c = b * 1 - 0; d = c / 1;
+a = 5; a = a; b = a;
+a = 1 / 0; a = 2;
+a = b / 0; a = 2;
+a = 7 / c; a = 3; b = a;
+a = 0 / 0 + b;
+a = 9223372036854775807 + 1; b = a / 1; c = a / 7; d = 0 - a / 2;
+a = 1; a = 2; a = 3; b = a * a; a = 4;
+a = b * 0; a = a + 1; c = (a + 0) * (1 * a);
+x = 100; y = x / 3 / 7 * 21; x = y / 0;
+EOF
+
+s=1
+while [ $s -le "$SEEDS" ]; do
+    for opts in "--vars=3 --digits=1 --factors=3" \
+                "--vars=3 --digits=1 --factors=3 --safe-div" \
+                "--vars=5 --literals=0.6 --digits=2 --terms=8 --depth=3 --safe-div"; do
+        "$GEN" --statements=12 --seed=$s $opts > "$DIR/gen.txt" || fail "$GEN failed"
+        check "$DIR/gen.txt"
+    done
+    s=$((s + 1))
+done
+echo "vm-test: ok ($COUNT programs)"
@@ -0,0 +1,350 @@
+/*
+  bench.cpp - the measurement modes: --bench (lexing, parsing,
+  streaming and evaluation of one file), --bench-edits (incremental
+  reparsing against full parses) and --vm-profile (opcode pairs and
+  triples).
+*/
+
+#include "../compiler.h"
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <unordered_map>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/*****************************************************/
+/*
+bench - time lexing, parsing and streaming of the mapped source: one
+untimed warmup, then `trials` timed runs of each phase. Prints the
+median and best time with throughput in MB/s, tokens/s and
+statements/s (statements = ';' tokens). The program must be valid.
+*/
+static void benchRow(const char* name, std::vector<double>& t, size_t statements);
+static void benchBinary(int trials, size_t statements);
+
+static void benchParse() {
+    tokPos = (size_t)-1;
+    advance();
+    if (parseJobs > 1) {
+        parseParallel(parseJobs);
+    } else {
+        program();
+    }
+    if (nextToken != EOF) {
+        error("Unexpected symbols after end of program");
+    }
+}
+
+static void benchStream() {
+    useTokens = false;
+    lseek(fileno(in_fp), 0, SEEK_SET);
+    inPos = inLen = 0;
+    inBase = inLines = inLineStart = 0;
+    getChar();
+    lex();
+    program();
+    if (nextToken != EOF) {
+        error("Unexpected symbols after end of program");
+    }
+    useTokens = true;
+}
+
+void bench(int trials) {
+    const char* names[4] = { "lex", "parse", "lex+parse", "stream" };
+    std::vector<double> t[4];
+
+    for (int run = 0; run <= trials; run++) { // run 0 is the warmup
+        Clock::time_point t0 = Clock::now();
+        tokenBuf.clear();
+        tokenizeParallel(source, sourceLen, lexJobs, tokenBuf);
+        useTokenArray(source, sourceLen, tokenBuf);
+        double lexTime = since(t0);
+
+        t0 = Clock::now();
+        benchParse();
+        double parseTime = since(t0);
+
+        double streamTime = 0;
+        if (inSeekable) {
+            t0 = Clock::now();
+            benchStream();
+            streamTime = since(t0);
+        }
+
+        if (run > 0) {
+            t[0].push_back(lexTime);
+            t[1].push_back(parseTime);
+            t[2].push_back(lexTime + parseTime);
+            t[3].push_back(streamTime);
+        }
+    }
+
+    size_t statements = 0;
+    for (const Token& tk : tokenBuf) {
+        statements += tk.kind == SEMICOLON;
+    }
+
+    printf("bench: %s, %zu bytes, %zu tokens, %zu statements, %d trials"
+           " (jobs=%d, parse-jobs=%d)\n",
+           srcPath, sourceLen, tokenCount, statements, trials, lexJobs, parseJobs);
+    printf("%-10s %10s %10s %10s %10s %10s\n",
+           "phase", "median ms", "best ms", "MB/s", "Mtok/s", "Mstmt/s");
+    for (int p = 0; p < 4; p++) {
+        if (p == 3 && !inSeekable) {
+            break;
+        }
+        benchRow(names[p], t[p], statements);
+    }
+    if (emitPath != NULL) {
+        benchBinary(trials, statements);
+    }
+}
+
+/* benchRow - one line of the bench table */
+static void benchRow(const char* name, std::vector<double>& t, size_t statements) {
+    std::sort(t.begin(), t.end());
+    double med = t[t.size() / 2];
+    printf("%-10s %10.2f %10.2f %10.1f %10.2f %10.3f\n",
+           name, med * 1e3, t[0] * 1e3,
+           sourceLen / med / 1e6, tokenCount / med / 1e6, statements / med / 1e6);
+}
+
+/*****************************************************/
+/*
+benchBinary - bench with --emit-binary: lex+parse building the AST,
+writing it once, then loading the written file (map and verify, as
+--load-binary does) and evaluating it, with --vm also on the bytecode
+VM as compiled, with superinstructions, and with the peephole pass as
+well. Rates are per source byte and
+token so they compare directly with reparsing.
+*/
+static void benchBinary(int trials, size_t statements) {
+    std::vector<double> t[7];
+    Ast built;
+    Bytecode vm[3];
+    const int vmPasses[3] = { 0, BC_FUSE, BC_PASSES };
+    double vmTime[3] = {};
+    for (int run = 0; run <= trials; run++) {
+        Clock::time_point t0 = Clock::now();
+        built = Ast();
+        ast = &built;
+        tokenBuf.clear();
+        tokenizeParallel(source, sourceLen, lexJobs, tokenBuf);
+        useTokenArray(source, sourceLen, tokenBuf);
+        advance();
+        program();
+        ast = NULL;
+        double parseTime = since(t0);
+
+        if (run == 0 && !writeBinary(astProgram(built), emitPath)) {
+            std::cerr << "ERROR - cannot write " << emitPath << "\n";
+            exit(1);
+        }
+
+        t0 = Clock::now();
+        Program prog;
+        std::string why;
+        if (!loadBinary(emitPath, prog, why)) {
+            std::cerr << "ERROR - " << emitPath << ": " << why << "\n";
+            exit(1);
+        }
+        double loadTime = since(t0);
+
+        t0 = Clock::now();
+        std::vector<int64_t> vars;
+        evalProgram(prog, vars, why);
+        double evalTime = since(t0);
+
+        double exactTime = 0;
+        if (exactOn) {
+            t0 = Clock::now();
+            ExactState st;
+            evalExact(built, st, why);
+            exactTime = since(t0);
+        }
+
+        if (vmOn) {
+            for (int i = 0; i < 3; i++) {
+                compileBytecode(prog, vm[i], why, vmPasses[i]);
+                t0 = Clock::now();
+                runBytecode(prog, vm[i], vars, why);
+                vmTime[i] = since(t0);
+            }
+        }
+
+        unloadBinary(prog);
+
+        if (run > 0) {
+            t[0].push_back(parseTime);
+            t[1].push_back(loadTime);
+            t[2].push_back(evalTime);
+            t[3].push_back(exactTime);
+            for (int i = 0; i < 3; i++) {
+                t[4 + i].push_back(vmTime[i]);
+            }
+        }
+    }
+    benchRow("parse+ast", t[0], statements);
+    benchRow("load", t[1], statements);
+    benchRow("eval", t[2], statements);
+    if (exactOn) {
+        benchRow("eval exact", t[3], statements);
+    }
+    if (vmOn) {
+        benchRow("vm", t[4], statements);
+        benchRow("vm fused", t[5], statements);
+        benchRow("vm peep", t[6], statements);
+        printf("vm dispatches per eval: %zu, fused %zu, peephole %zu\n",
+               vm[0].code.size(), vm[1].code.size(), vm[2].code.size());
+    }
+}
+
+/*****************************************************/
+/*
+vmProfile - --vm-profile: compile each file and count the opcode pairs
+and triples of its code, within statements. The code has no branches,
+so these static counts are also the dynamic counts of one run. Prints
+the most frequent sequences across all the files.
+*/
+int vmProfile(const std::vector<const char*>& files) {
+    std::unordered_map<uint32_t, uint64_t> seqs[2];  // pairs, triples; key = ops in bytes
+    uint64_t total = 0, totalFused = 0, totalOpt = 0;
+    Ast built;
+    Bytecode bc;
+    for (const char* path : files) {
+        int fd = open(path, O_RDONLY);
+        const char* data;
+        size_t len;
+        if (fd < 0 || !mapFile(fd, data, len)) {
+            std::cerr << "ERROR - cannot open " << path << "\n";
+            return 1;
+        }
+        close(fd);
+        built = Ast();
+        ast = &built;
+        std::string diag;
+        uint64_t line, col;
+        bool ok = parseTrapped(data, len, path, diag, line, col);
+        ast = NULL;
+        if (len > 0) {
+            munmap((void*)data, len);
+        }
+        if (!ok) {
+            continue;  // invalid programs (tests/a3, a5, a7) have no code
+        }
+        compileBytecode(astProgram(built), bc, diag, 0);
+        total += bc.code.size();
+        Bytecode opt;
+        compileBytecode(astProgram(built), opt, diag, BC_FUSE);
+        totalFused += opt.code.size();
+        compileBytecode(astProgram(built), opt, diag);
+        totalOpt += opt.code.size();
+        uint32_t from = 0;
+        for (uint32_t to : bc.stmtEnd) {
+            for (uint32_t pc = from; pc < to; pc++) {
+                uint32_t key = bc.code[pc].op;
+                for (int len = 2; len <= 3 && pc + len <= to; len++) {
+                    key = key << 8 | bc.code[pc + len - 1].op;
+                    seqs[len - 2][key]++;
+                }
+            }
+            from = to;
+        }
+    }
+
+    printf("%llu instructions, %llu with superinstructions (%.1f%% fewer),"
+           " %llu also with peephole (%.1f%% fewer)\n",
+           (unsigned long long)total, (unsigned long long)totalFused,
+           total ? 100.0 * (double)(total - totalFused) / (double)total : 0.0,
+           (unsigned long long)totalOpt,
+           total ? 100.0 * (double)(total - totalOpt) / (double)total : 0.0);
+    for (int len = 2; len <= 3; len++) {
+        std::vector<std::pair<uint64_t, uint32_t>> top;
+        for (const auto& e : seqs[len - 2]) {
+            top.emplace_back(e.second, e.first);
+        }
+        std::sort(top.rbegin(), top.rend());
+        printf("\n%-24s %12s %8s\n", len == 2 ? "pair" : "triple", "count", "%");
+        for (size_t i = 0; i < top.size() && i < 12; i++) {
+            std::string name;
+            for (int j = len - 1; j >= 0; j--) {
+                name += bcName((int)(top[i].second >> (8 * j) & 0xFF));
+                name += j > 0 ? " " : "";
+            }
+            printf("%-24s %12llu %8.2f\n", name.c_str(), (unsigned long long)top[i].first,
+                   total ? 100.0 * (double)top[i].first / (double)total : 0.0);
+        }
+    }
+    return 0;
+}
+
+/*****************************************************/
+/*
+benchEdits - --bench-edits: random single-character edits (insert one
+of a few program characters, or delete one) on the mapped source,
+each timed through docEdit() + docUpdate() and through a full
+parseBuffer() of the same text, then undone. Prints latency percentiles for both and
+checks that they always agree.
+*/
+void benchEdits(int trials) {
+    Document doc;
+    Clock::time_point t0 = Clock::now();
+    docOpen(doc, srcPath, source, sourceLen);
+    docUpdate(doc);
+    double openTime = since(t0);
+
+    std::mt19937_64 rng(1);
+    const char chars[] = "ab1+-*/();= \n~";
+    std::vector<double> inc, full;
+    size_t mismatches = 0, reparsed = 0;
+    std::string diag;
+    for (int run = 0; run < trials; run++) {
+        if (doc.text.empty()) {
+            break;
+        }
+        size_t off = rng() % doc.text.size();
+        bool insert = rng() % 2 == 0;
+        char c = insert ? chars[rng() % (sizeof(chars) - 1)] : doc.text[off];
+
+        for (int undo = 0; undo < 2; undo++) {
+            t0 = Clock::now();
+            if (insert != (undo == 1)) {
+                docEdit(doc, off, 0, &c, 1);
+            } else {
+                docEdit(doc, off, 1, "", 0);
+            }
+            docUpdate(doc);
+            inc.push_back(since(t0));
+            reparsed += doc.reparsed;
+
+            t0 = Clock::now();
+            bool ok = parseBuffer(doc.text.data(), doc.text.size(), srcPath, diag);
+            full.push_back(since(t0));
+            if (ok != doc.ok || (!ok && diag != doc.diag)) {
+                mismatches++;
+            }
+        }
+    }
+
+    printf("bench-edits: %s, %zu bytes, %zu statements, %zu edits (open %.2f ms)\n",
+           srcPath, doc.text.size(), doc.semis.size(), inc.size(), openTime * 1e3);
+    printf("%-12s %10s %10s %10s %10s\n", "", "p50 us", "p90 us", "p99 us", "max us");
+    for (std::vector<double>* v : { &inc, &full }) {
+        if (v->empty()) {
+            break;
+        }
+        std::sort(v->begin(), v->end());
+        auto pct = [&](double q) { return (*v)[(size_t)(q * (v->size() - 1))] * 1e6; };
+        printf("%-12s %10.1f %10.1f %10.1f %10.1f\n", v == &inc ? "incremental" : "full",
+               pct(0.50), pct(0.90), pct(0.99), v->back() * 1e6);
+    }
+    printf("statements reparsed per edit: %.2f, mismatches: %zu\n",
+           inc.empty() ? 0.0 : (double)reparsed / inc.size(), mismatches);
+}
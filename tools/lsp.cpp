@@ -0,0 +1,389 @@
+/*
+  lsp.cpp - the language server (--lsp): JSON-RPC over stdin and
+  stdout, with diagnostics from incremental documents.
+*/
+
+#include "../compiler.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <algorithm>
+#include <vector>
+#include <unordered_map>
+#include <poll.h>
+#include <strings.h>
+
+/*****************************************************/
+/*
+Json - just enough JSON for LSP messages: a parsed value, with
+obj["key"] returning a null value when the key is missing
+*/
+struct Json {
+    enum Type { NUL, BOOL, NUM, STR, ARR, OBJ } type = NUL;
+    bool        b = false;
+    double      num = 0;
+    std::string str;
+    std::vector<Json> arr;
+    std::vector<std::pair<std::string, Json>> obj;
+
+    const Json& operator[](const char* key) const {
+        static const Json none;
+        for (const auto& kv : obj) {
+            if (kv.first == key) {
+                return kv.second;
+            }
+        }
+        return none;
+    }
+};
+
+/* jsonSkip - skip JSON whitespace */
+static void jsonSkip(const char*& p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+        p++;
+    }
+}
+
+/* jsonString - parse a string literal at p (after the quote) into out,
+   \uXXXX escapes as UTF-8 */
+static bool jsonString(const char*& p, const char* end, std::string& out) {
+    out.clear();
+    while (p < end && *p != '"') {
+        char c = *p++;
+        if (c != '\\') {
+            out += c;
+            continue;
+        }
+        if (p == end) {
+            return false;
+        }
+        c = *p++;
+        switch (c) {
+            case 'n': out += '\n'; break;
+            case 't': out += '\t'; break;
+            case 'r': out += '\r'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'u': {
+                if (end - p < 4) {
+                    return false;
+                }
+                unsigned u = (unsigned)strtoul(std::string(p, 4).c_str(), NULL, 16);
+                p += 4;
+                if (u < 0x80) {
+                    out += (char)u;
+                } else if (u < 0x800) {
+                    out += (char)(0xc0 | (u >> 6));
+                    out += (char)(0x80 | (u & 0x3f));
+                } else {
+                    out += (char)(0xe0 | (u >> 12));
+                    out += (char)(0x80 | ((u >> 6) & 0x3f));
+                    out += (char)(0x80 | (u & 0x3f));
+                }
+                break;
+            }
+            default: out += c; break;   // '"', '\\', '/'
+        }
+    }
+    if (p == end) {
+        return false;
+    }
+    p++; // closing quote
+    return true;
+}
+
+/* jsonParse - parse one value at p; depth bounds nesting */
+static bool jsonParse(const char*& p, const char* end, Json& out, int depth = 0) {
+    jsonSkip(p, end);
+    if (p == end || depth > 64) {
+        return false;
+    }
+    if (*p == '{') {
+        out.type = Json::OBJ;
+        p++;
+        jsonSkip(p, end);
+        if (p < end && *p == '}') {
+            p++;
+            return true;
+        }
+        for (;;) {
+            jsonSkip(p, end);
+            std::string key;
+            if (p == end || *p++ != '"' || !jsonString(p, end, key)) {
+                return false;
+            }
+            jsonSkip(p, end);
+            if (p == end || *p++ != ':') {
+                return false;
+            }
+            out.obj.emplace_back(key, Json());
+            if (!jsonParse(p, end, out.obj.back().second, depth + 1)) {
+                return false;
+            }
+            jsonSkip(p, end);
+            if (p < end && *p == ',') {
+                p++;
+            } else if (p < end && *p == '}') {
+                p++;
+                return true;
+            } else {
+                return false;
+            }
+        }
+    }
+    if (*p == '[') {
+        out.type = Json::ARR;
+        p++;
+        jsonSkip(p, end);
+        if (p < end && *p == ']') {
+            p++;
+            return true;
+        }
+        for (;;) {
+            out.arr.emplace_back();
+            if (!jsonParse(p, end, out.arr.back(), depth + 1)) {
+                return false;
+            }
+            jsonSkip(p, end);
+            if (p < end && *p == ',') {
+                p++;
+            } else if (p < end && *p == ']') {
+                p++;
+                return true;
+            } else {
+                return false;
+            }
+        }
+    }
+    if (*p == '"') {
+        out.type = Json::STR;
+        p++;
+        return jsonString(p, end, out.str);
+    }
+    if (end - p >= 4 && memcmp(p, "true", 4) == 0) {
+        out.type = Json::BOOL;
+        out.b = true;
+        p += 4;
+        return true;
+    }
+    if (end - p >= 5 && memcmp(p, "false", 5) == 0) {
+        out.type = Json::BOOL;
+        p += 5;
+        return true;
+    }
+    if (end - p >= 4 && memcmp(p, "null", 4) == 0) {
+        p += 4;
+        return true;
+    }
+    const char* q = p;
+    while (q < end && strchr("+-0123456789.eE", *q) != NULL) {
+        q++;
+    }
+    if (q == p) {
+        return false;
+    }
+    out.type = Json::NUM;
+    out.num = strtod(std::string(p, q).c_str(), NULL);
+    p = q;
+    return true;
+}
+
+/* jsonQuote - append s as a JSON string literal */
+static void jsonQuote(std::string& out, const std::string& s) {
+    out += '"';
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += (char)c;
+        } else if (c < 0x20) {
+            char esc[8];
+            snprintf(esc, sizeof(esc), "\\u%04x", c);
+            out += esc;
+        } else {
+            out += (char)c;
+        }
+    }
+    out += '"';
+}
+
+/* jsonId - a request id (number or string) as JSON text */
+static std::string jsonId(const Json& id) {
+    std::string out;
+    if (id.type == Json::STR) {
+        jsonQuote(out, id.str);
+    } else if (id.type == Json::NUM) {
+        out = std::to_string((long long)id.num);
+    } else {
+        out = "null";
+    }
+    return out;
+}
+
+/*****************************************************/
+/* lspSend - write one message with its Content-Length header */
+static void lspSend(const std::string& body) {
+    std::string msg = "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+    writeAll(1, msg.data(), msg.size());
+}
+
+/*****************************************************/
+/* lspOffset - byte offset of an LSP position, clamped to its line.
+   Characters are counted as bytes, which is what UTF-16 units are for
+   the ASCII the language is written in. */
+static size_t lspOffset(const Document& doc, const Json& pos) {
+    size_t line = (size_t)std::max(0.0, pos["line"].num);
+    size_t ch = (size_t)std::max(0.0, pos["character"].num);
+    if (line >= doc.lines.size()) {
+        return doc.text.size();
+    }
+    size_t start = doc.lines[line];
+    size_t end = line + 1 < doc.lines.size() ? doc.lines[line + 1] - 1 : doc.text.size();
+    return std::min(start + ch, end);
+}
+
+/*****************************************************/
+/* lspPosition - LSP {line, character} of a byte offset */
+static std::string lspPosition(const Document& doc, size_t offset) {
+    size_t k = std::upper_bound(doc.lines.begin(), doc.lines.end(), (uint32_t)offset)
+               - doc.lines.begin() - 1;
+    return "{\"line\":" + std::to_string(k) + ",\"character\":"
+           + std::to_string(offset - doc.lines[k]) + "}";
+}
+
+/*****************************************************/
+/* lspPublish - bring a document up to date and send its diagnostics:
+   none, or the first error with the range of the token it is at */
+static void lspPublish(const std::string& uri, Document* doc) {
+    std::string body = "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/publishDiagnostics\","
+                       "\"params\":{\"uri\":";
+    jsonQuote(body, uri);
+    body += ",\"diagnostics\":[";
+    if (doc != NULL) {
+        Clock::time_point t0 = Clock::now();
+        docUpdate(*doc);
+        if (statsOn) {
+            fprintf(stderr, "lsp: %s: %zu statements reparsed in %.3f ms\n",
+                    uri.c_str(), doc->reparsed, since(t0) * 1e3);
+        }
+        if (!doc->ok) {
+            body += "{\"range\":{\"start\":" + lspPosition(*doc, doc->errOffset)
+                    + ",\"end\":" + lspPosition(*doc, doc->errOffset + doc->errLength)
+                    + "},\"severity\":1,\"source\":\"rdp\",\"message\":";
+            jsonQuote(body, doc->errMessage);
+            body += "}";
+        }
+    }
+    body += "]}}";
+    lspSend(body);
+}
+
+/*****************************************************/
+/*
+lspServe - --lsp: a language server on stdin/stdout. Open documents
+are kept as Documents; each change is applied with docEdit() at once,
+but checking and publishing wait until no message has arrived for
+LSP_DEBOUNCE_MS, so a burst of keystrokes costs one docUpdate().
+A message longer than SERVE_MAX_SRC gets an error reply and is read
+past without being stored. Returns the exit status ("exit" after "shutdown" is 0).
+*/
+int lspServe() {
+    Conn in(0);
+    std::unordered_map<std::string, Document> docs;
+    std::vector<std::string> pending;  // uris with unpublished changes
+    bool shutdown = false;
+    std::string header, body;
+
+    for (;;) {
+        if (!pending.empty() && in.pos == in.len) {
+            struct pollfd pfd = { 0, POLLIN, 0 };
+            if (poll(&pfd, 1, LSP_DEBOUNCE_MS) == 0) {
+                for (const std::string& uri : pending) {
+                    auto it = docs.find(uri);
+                    lspPublish(uri, it == docs.end() ? NULL : &it->second);
+                }
+                pending.clear();
+                continue;
+            }
+        }
+
+        size_t length = 0;
+        bool headers = false;
+        while (in.line(header, SERVE_MAX_LINE)) {
+            if (!header.empty() && header.back() == '\r') {
+                header.pop_back();
+            }
+            if (header.empty()) {
+                headers = true;
+                break;
+            }
+            if (strncasecmp(header.c_str(), "Content-Length:", 15) == 0) {
+                length = strtoull(header.c_str() + 15, NULL, 10);
+            }
+        }
+        if (headers && length > SERVE_MAX_SRC) {
+            lspSend("{\"jsonrpc\":\"2.0\",\"id\":null,\"error\":{\"code\":-32600,\"message\":"
+                    "\"Content-Length above " + std::to_string(SERVE_MAX_SRC) + "\"}}");
+            if (!in.skip(length)) {
+                return shutdown ? 0 : 1;
+            }
+            continue;
+        }
+        if (!headers || !in.bytes(length, body)) {
+            return shutdown ? 0 : 1;   // stdin closed
+        }
+
+        Json msg;
+        const char* p = body.data();
+        if (!jsonParse(p, body.data() + body.size(), msg)) {
+            lspSend("{\"jsonrpc\":\"2.0\",\"id\":null,\"error\":{\"code\":-32700,\"message\":\"Parse error\"}}");
+            continue;
+        }
+        const std::string& method = msg["method"].str;
+        const Json& id = msg["id"];
+        const Json& params = msg["params"];
+        const std::string& uri = params["textDocument"]["uri"].str;
+
+        if (method == "initialize") {
+            lspSend("{\"jsonrpc\":\"2.0\",\"id\":" + jsonId(id) + ",\"result\":{\"capabilities\":"
+                    "{\"textDocumentSync\":{\"openClose\":true,\"change\":2}},"
+                    "\"serverInfo\":{\"name\":\"rdp\"}}}");
+        } else if (method == "shutdown") {
+            shutdown = true;
+            lspSend("{\"jsonrpc\":\"2.0\",\"id\":" + jsonId(id) + ",\"result\":null}");
+        } else if (method == "exit") {
+            return shutdown ? 0 : 1;
+        } else if (method == "textDocument/didOpen") {
+            const std::string& text = params["textDocument"]["text"].str;
+            docOpen(docs[uri], uri.c_str(), text.data(), text.size());
+            pending.push_back(uri);
+        } else if (method == "textDocument/didChange") {
+            auto it = docs.find(uri);
+            if (it == docs.end()) {
+                continue;
+            }
+            Document& doc = it->second;
+            for (const Json& change : params["contentChanges"].arr) {
+                const Json& range = change["range"];
+                if (range.type == Json::OBJ) {
+                    size_t from = lspOffset(doc, range["start"]);
+                    size_t to = std::max(from, lspOffset(doc, range["end"]));
+                    docEdit(doc, from, to - from, change["text"].str.data(), change["text"].str.size());
+                } else {
+                    docOpen(doc, uri.c_str(), change["text"].str.data(), change["text"].str.size());
+                }
+            }
+            if (std::find(pending.begin(), pending.end(), uri) == pending.end()) {
+                pending.push_back(uri);
+            }
+        } else if (method == "textDocument/didClose") {
+            docs.erase(uri);
+            pending.erase(std::remove(pending.begin(), pending.end(), uri), pending.end());
+            lspPublish(uri, NULL);
+        } else if (id.type != Json::NUL) {
+            lspSend("{\"jsonrpc\":\"2.0\",\"id\":" + jsonId(id)
+                    + ",\"error\":{\"code\":-32601,\"message\":\"Method not found\"}}");
+        }
+    }
+}
@@ -0,0 +1,196 @@
+/*
+  repl.cpp - the interactive mode (--repl): statements and
+  expressions read a line at a time and run as bytecode.
+*/
+
+#include "../compiler.h"
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+/*****************************************************/
+/*
+replParse - parse one REPL line into env: statements through
+assignment_statement(), anything else as a single expression whose
+nodes are returned in first/root. Throws ParseFailed.
+*/
+static bool replParse(Ast& env, uint32_t& first, uint32_t& root) {
+    advance();
+    if (nextToken == IDENT && peek(1) == ASSIGN_OP) {
+        while (nextToken == IDENT) {
+            assignment_statement();
+        }
+        if (nextToken != EOF) {
+            error("Unexpected symbols after assignment_statement");
+        }
+        return true;
+    }
+    first = (uint32_t)env.nodes.size();
+    chainTerms.clear();
+    root = expr();
+    if (nextToken != EOF) {
+        error("Unexpected symbols after expression");
+    }
+    return false;
+}
+
+/* ReplMark - the size of each part of env before a line */
+struct ReplMark {
+    size_t nodes, stmts, consts, syms, names, bigLits;
+};
+
+static ReplMark replMark(const Ast& env) {
+    return ReplMark{ env.nodes.size(), env.stmts.size(), env.consts.size(),
+                     env.syms.size(), env.names.size(), env.bigLits.size() };
+}
+
+/* replRollback - discard everything a line added to env */
+static void replRollback(Ast& env, const ReplMark& m) {
+    for (size_t s = m.syms; s < env.syms.size(); s++) {
+        env.symIndex.erase(env.names.substr(env.syms[s].off, env.syms[s].len));
+    }
+    env.nodes.resize(m.nodes);
+    env.stmts.resize(m.stmts);
+    env.consts.resize(m.consts);
+    env.syms.resize(m.syms);
+    env.names.resize(m.names);
+    env.bigLits.resize(m.bigLits);
+}
+
+/*****************************************************/
+/*
+repl - --repl: read statements and expressions from standard input one
+line at a time. Each line is parsed onto one growing AST, so earlier
+lines are never parsed again, and only its new statements are compiled
+to bytecode (with the --vm passes) and run against the persistent
+variables; an expression prints its value. A line that fails to parse
+or run leaves the AST and the variables as they were. Commands:
+`:time expr` (compile and evaluation cost), `:vars`, `:quit`.
+*/
+int repl() {
+    Ast env;
+    Bytecode bc;  // the current line's
+    std::vector<int64_t> vars, next;
+    std::vector<Token> toks;
+    std::string line;
+    bool prompt = isatty(0);
+    trapErrors = true;
+    srcPath = "repl";
+
+    for (uint64_t lineNo = 1; ; lineNo++) {
+        if (prompt) {
+            fputs("> ", stdout);
+            fflush(stdout);
+        }
+        if (!std::getline(std::cin, line) || line == ":quit") {
+            return 0;
+        }
+        bool timed = line.compare(0, 6, ":time ") == 0;
+        size_t from = timed ? 6 : 0;
+        if (line == ":vars") {
+            std::vector<bool> assigned(env.syms.size(), false);
+            for (const Stmt& st : env.stmts) {
+                assigned[st.target] = true;
+            }
+            for (size_t s = 0; s < env.syms.size(); s++) {
+                if (assigned[s]) {
+                    printf("%.*s = %lld\n", (int)env.syms[s].len, env.names.data() + env.syms[s].off,
+                           (long long)vars[s]);
+                }
+            }
+            continue;
+        }
+        // a failed line leaves nothing behind
+        ReplMark mark = replMark(env);
+        uint32_t stmts = (uint32_t)mark.stmts;
+        Clock::time_point t0 = Clock::now();
+        toks.clear();
+        tokenize(line.data(), from, line.size(), toks);
+        if (toks.size() == 1 && toks[0].kind == EOF && toks[0].length == 0) {
+            continue; // blank or comment
+        }
+        useTokenArray(line.data(), line.size(), toks);
+        ast = &env;
+        uint32_t first = 0, root = 0;
+        bool assign;
+        try {
+            assign = replParse(env, first, root);
+        } catch (const ParseFailed& e) {
+            uint64_t l, col;
+            std::cerr << errorBody(e.message, l, col) << errorLocation(srcPath, lineNo, col);
+            replRollback(env, mark);
+            depth = 0;
+            ast = NULL;
+            continue;
+        }
+        ast = NULL;
+        if (assign && timed) {
+            std::cerr << "Error: :time takes an expression\n";
+            replRollback(env, mark);
+            continue;
+        }
+
+        // an expression is compiled as a statement storing to a scratch
+        // slot past the variables
+        uint32_t result = (uint32_t)env.syms.size();
+        if (!assign) {
+            env.syms.push_back(Sym{ (uint32_t)env.names.size(), 0 });
+            env.stmts.push_back(Stmt{ result, first, root });
+        }
+        Program prog = astProgram(env);
+        Program lineProg = prog;  // this line's statements only
+        lineProg.stmts += stmts;
+        lineProg.stmtCount -= stmts;
+        std::string why, diag;
+        if (!compileBytecode(lineProg, bc, why, vmPasses)) {
+            std::cerr << "Runtime error: bad bytecode: " << why << "\n";
+            replRollback(env, mark);
+            continue;
+        }
+        double compileTime = since(t0);
+        vars.resize(mark.syms, 0);
+        if (assign) {
+            next = vars;  // committed only if every statement runs
+            if (!runBytecode(lineProg, bc, next, diag)) {
+                std::cerr << diag;
+                replRollback(env, mark);
+                continue;
+            }
+            vars.swap(next);
+            for (uint32_t i = stmts; i < prog.stmtCount; i++) {
+                const Sym& t = prog.syms[prog.stmts[i].target];
+                printf("%.*s = %lld\n", (int)t.len, prog.names + t.off,
+                       (long long)vars[prog.stmts[i].target]);
+            }
+            continue; // keep the statements for :vars
+        }
+
+        if (!runBytecode(lineProg, bc, vars, diag)) {
+            std::cerr << "Runtime error: division by zero\n";
+        } else if (!timed) {
+            printf("%lld\n", (long long)vars[result]);
+        } else {
+            // repeat until the total is long enough to time reliably
+            uint64_t runs = 0;
+            t0 = Clock::now();
+            double elapsed;
+            do {
+                for (int k = 0; k < 1000; k++) {
+                    runBytecode(lineProg, bc, vars, diag);
+                }
+                runs += 1000;
+                elapsed = since(t0);
+            } while (elapsed < REPL_TIME_MIN);
+            printf("%lld\n", (long long)vars[result]);
+            printf("parse+compile %.3f us, %u nodes, %zu instructions, eval %.1f ns (%llu runs)\n",
+                   compileTime * 1e6, root - first + 1, bc.code.size(), elapsed * 1e9 / runs,
+                   (unsigned long long)runs);
+        }
+        vars.resize(result);
+        replRollback(env, mark);  // expressions are not kept
+    }
+}
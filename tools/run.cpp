@@ -0,0 +1,186 @@
+/*
+  run.cpp - the default mode: check one file as the command line
+  asked, by streaming or pre-lexing it, through the cache, evaluating,
+  emitting or loading a binary program.
+*/
+
+#include "../compiler.h"
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*****************************************************/
+/*
+runFile - check one file (or "-" for standard input) as the command
+line asked: streamed or pre-lexed, cached, evaluated, emitted or
+loaded as a binary program. Returns the exit status.
+*/
+int runFile(const char* path) {
+    uint64_t fileStart = traceOn ? traceNow() : 0;
+    if (loadBinaryOn) {
+        Program prog;
+        std::string why;
+        if (!loadBinary(path, prog, why)) {
+            std::cerr << "ERROR - " << path << ": " << why << "\n";
+            return 1;
+        }
+        STATS(stats.io = since(stats.start));
+        if (traceOn) {
+            traceRecord("load", fileStart, path);
+        }
+        int status = 0;
+        if (evalOn) {
+            status = runProgram(prog);
+        } else {
+            std::cout << "Binary program loaded successfully.\n";
+        }
+        unloadBinary(prog);
+        return status;
+    }
+    static Ast mainAst;
+    if (evalOn || emitPath != NULL) {
+        ast = &mainAst;
+    }
+    uint64_t key = 0;                  // content hash, --cache only
+
+    // InFile - closes in_fp on every return, early ones included
+    struct InFile {
+        ~InFile() {
+            if (in_fp != NULL && in_fp != stdin) {
+                fclose(in_fp);
+            }
+            in_fp = NULL;
+        }
+    } closeInput;
+    if (strcmp(path, "-") == 0) {
+        in_fp = stdin;
+        srcPath = "<stdin>";
+    } else if ((in_fp = fopen(path, "r")) == NULL) {
+        std::cerr << "ERROR - cannot open " << path << "\n";
+        return 1;
+    } else {
+        srcPath = path;
+    }
+    STATS(stats.open = since(stats.start));
+    struct stat st;
+    inSeekable = fstat(fileno(in_fp), &st) == 0 && S_ISREG(st.st_mode)
+                 && lseek(fileno(in_fp), 0, SEEK_CUR) == 0;
+
+    if (useTokens) {
+        // map the whole file, then lex it before parsing
+        Clock::time_point t0 = Clock::now();
+        if (!loadSource(in_fp)) {
+            std::cerr << "ERROR - cannot map " << path << "\n";
+            return 1;
+        }
+        if (sourceLen > UINT32_MAX) {
+            std::cerr << "ERROR - " << path << " is too large for --tokens (4 GiB max)\n";
+            return 1;
+        }
+        if (benchTrials > 0) {
+            bench(benchTrials);
+            return 0;
+        }
+        if (editTrials > 0) {
+            benchEdits(editTrials);
+            return 0;
+        }
+        STATS(stats.io = since(t0); t0 = Clock::now());
+        if (cacheDir != NULL) {
+            // an unchanged file is answered from its entry, unlexed
+            key = hash64(source, sourceLen, PARSER_VERSION);
+            STATS(stats.hash = since(t0));
+            std::string diag;
+            int hit = cacheLookup(key, sourceLen, srcPath, diag);
+            Program prog;
+            std::string why;
+            if (hit == 1 && ast && (exactOn || !loadBinary((cachePath(key) + ".bin").c_str(), prog, why))) {
+                STATS(stats.cacheHits--);
+                hit = -1; // no usable program saved with the entry
+            }
+            if (hit >= 0) {
+                if (hit == 0) {
+                    if (traceOn) {
+                        traceRecord("file", fileStart, path);
+                    }
+                    std::cerr << diag;
+                    return 1;
+                }
+                std::cout << "Parsing completed successfully.\n";
+                int status = 0;
+                if (emitPath != NULL && !writeBinary(prog, emitPath)) {
+                    std::cerr << "ERROR - cannot write " << emitPath << "\n";
+                    status = 1;
+                } else if (evalOn) {
+                    status = runProgram(prog);
+                }
+                unloadBinary(prog);
+                if (traceOn) {
+                    traceRecord("file", fileStart, path);
+                }
+                return status;
+            }
+            trapErrors = true; // store a failure before reporting it
+            STATS(t0 = Clock::now());
+        }
+        phaseBegin("lex");
+        tokenizeParallel(source, sourceLen, lexJobs, tokenBuf);
+        useTokenArray(source, sourceLen, tokenBuf);
+        phaseEnd();
+        phaseBegin("parse");
+        STATS(stats.lex = since(t0); countTokens(tokenBuf));
+    } else {
+        phaseBegin("lex+parse");
+        getChar(); // prime first character
+        lex();     // prime first token
+    }
+
+    Clock::time_point t0 = Clock::now();
+    try {
+        if (useTokens) {
+            advance(); // prime first token
+        }
+        if (parseJobs > 1 && !ast) {
+            parseParallel(parseJobs);
+        } else {
+            program();
+        }
+
+        if (nextToken != EOF) {
+            error("Unexpected symbols after end of program");
+        }
+    } catch (const ParseFailed& e) {
+        // only trapped with --cache
+        uint64_t line, col;
+        std::string body = errorBody(e.message, line, col);
+        cacheStore(key, sourceLen, false, body, line, col);
+        std::cerr << body << errorLocation(srcPath, line, col);
+        return 1;
+    }
+    STATS(stats.parse = since(t0));
+    phaseEnd();
+    if (cacheDir != NULL) {
+        cacheStore(key, sourceLen, true, "", 0, 0);
+        if (ast) {
+            writeBinary(astProgram(*ast), (cachePath(key) + ".bin").c_str());
+        }
+    }
+
+    std::cout << "Parsing completed successfully.\n";
+    int status = 0;
+    if (emitPath != NULL && !writeBinary(astProgram(*ast), emitPath)) {
+        std::cerr << "ERROR - cannot write " << emitPath << "\n";
+        status = 1;
+    } else if (evalOn) {
+        status = exactOn ? runExact(*ast) : runProgram(astProgram(*ast));
+    }
+    if (traceOn) {
+        traceRecord("file", fileStart, path);  // the whole file, evaluation included
+    }
+    return status;
+}
@@ -0,0 +1,291 @@
+/*
+  serve.cpp - the parse daemon (--serve) and its load-generating
+  client (--client) over a Unix stream socket.
+*/
+
+#include "../compiler.h"
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <string>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <csignal>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/*****************************************************/
+/*
+Daemon protocol (--serve / --client), over a Unix stream socket. Each
+connection carries any number of requests:
+    FILE <path>\n               parse a file the server can read
+    SRC <length>\n<bytes>       parse inline source
+and each gets one reply:
+    OK\n
+    ERR <length>\n<bytes>       the diagnostic ./main would print
+A request line longer than SERVE_MAX_LINE closes the connection, as
+does a SRC body larger than SERVE_MAX_SRC, after an ERR reply. The
+socket is only accessible to its owner: a client can make the server
+read any file the server can, and diagnostics quote from it.
+*/
+
+/*****************************************************/
+/* Conn::fill - refill buf from the socket; false at end of input */
+bool Conn::fill() {
+    ssize_t n;
+    do {
+        n = read(fd, buf, sizeof(buf));
+    } while (n < 0 && errno == EINTR);
+    pos = 0;
+    len = n > 0 ? (size_t)n : 0;
+    return len > 0;
+}
+
+/*****************************************************/
+/* Conn::line - one line without its '\n'; false at end of input or
+   past `max` bytes */
+bool Conn::line(std::string& out, size_t max) {
+    out.clear();
+    for (;;) {
+        if (pos == len && !fill()) {
+            return false;
+        }
+        char c = buf[pos++];
+        if (c == '\n') {
+            return true;
+        }
+        if (out.size() == max) {
+            return false;
+        }
+        out += c;
+    }
+}
+
+/*****************************************************/
+/* Conn::bytes - exactly n bytes into out */
+bool Conn::bytes(size_t n, std::string& out) {
+    out.clear();
+    while (out.size() < n) {
+        if (pos == len && !fill()) {
+            return false;
+        }
+        size_t take = std::min(n - out.size(), len - pos);
+        out.append(buf + pos, take);
+        pos += take;
+    }
+    return true;
+}
+
+/*****************************************************/
+/* Conn::skip - discard n bytes without keeping them */
+bool Conn::skip(size_t n) {
+    while (n > 0) {
+        if (pos == len && !fill()) {
+            return false;
+        }
+        size_t take = std::min(n, len - pos);
+        pos += take;
+        n -= take;
+    }
+    return true;
+}
+
+/*****************************************************/
+/* reply - send OK or ERR with the diagnostic */
+static bool reply(int fd, bool ok, const std::string& diag) {
+    std::string msg = ok ? "OK\n" : "ERR " + std::to_string(diag.size()) + "\n" + diag;
+    return writeAll(fd, msg.data(), msg.size());
+}
+
+/*****************************************************/
+/* serveFile - parse one FILE request */
+static bool serveFile(const std::string& path, std::string& diag) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        diag = "ERROR - cannot open " + path + "\n";
+        return false;
+    }
+    const char* data;
+    size_t len;
+    bool ok;
+    if (!mapFile(fd, data, len)) {
+        diag = "ERROR - cannot map " + path + "\n";
+        ok = false;
+    } else {
+        ok = parseCached(data, len, path.c_str(), diag);
+        if (len > 0) {
+            munmap((void*)data, len);
+        }
+    }
+    close(fd);
+    return ok;
+}
+
+/*****************************************************/
+/* serveConn - answer requests on one connection until it closes */
+static void serveConn(int fd) {
+    Conn in(fd);
+    std::string req, body, diag;
+    while (in.line(req, SERVE_MAX_LINE)) {
+        TraceSpan span("request");
+        bool ok;
+        diag.clear();
+        if (req.compare(0, 5, "FILE ") == 0) {
+            ok = serveFile(req.substr(5), diag);
+        } else if (req.compare(0, 4, "SRC ") == 0) {
+            unsigned long long n = strtoull(req.c_str() + 4, NULL, 10);
+            if (n > SERVE_MAX_SRC) {
+                reply(fd, false, "ERROR - source larger than " + std::to_string(SERVE_MAX_SRC)
+                                 + " bytes\n");
+                break;
+            }
+            if (!in.bytes((size_t)n, body)) {
+                break;
+            }
+            ok = parseCached(body.data(), body.size(), "<inline>", diag);
+        } else {
+            ok = false;
+            diag = "ERROR - bad request\n";
+        }
+        if (!reply(fd, ok, diag)) {
+            break;
+        }
+    }
+    close(fd);
+}
+
+/*****************************************************/
+/*
+serve - listen on a Unix socket; `threads` pool threads are started up
+front and each one accepts and serves connections itself, keeping its
+token array warm between requests. Runs until killed.
+*/
+int serve(const char* sockPath, int threads) {
+    signal(SIGPIPE, SIG_IGN);
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(sockPath) >= sizeof(addr.sun_path)) {
+        std::cerr << "ERROR - socket path too long: " << sockPath << "\n";
+        return 1;
+    }
+    strcpy(addr.sun_path, sockPath);
+
+    // replace only a stale socket, never some other file
+    struct stat st;
+    if (lstat(sockPath, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            std::cerr << "ERROR - cannot listen on " << sockPath << ": " << strerror(EADDRINUSE) << "\n";
+            return 1;
+        }
+        unlink(sockPath);
+    }
+
+    int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    mode_t mask = umask(0177);  // socket mode 0600: owner only
+    bool bound = lfd >= 0 && bind(lfd, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+    umask(mask);
+    if (!bound || listen(lfd, 128) != 0) {
+        std::cerr << "ERROR - cannot listen on " << sockPath << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+    std::cerr << "serving on " << sockPath << " with " << threads << " threads\n";
+
+    std::vector<std::thread> pool;
+    for (int t = 0; t < std::max(threads, 1); t++) {
+        pool.emplace_back([lfd] {
+            traceThread("server");
+            for (;;) {
+                int fd = accept(lfd, NULL, NULL);
+                if (fd >= 0) {
+                    serveConn(fd);
+                } else if (errno != EINTR && errno != ECONNABORTED) {
+                    return;
+                }
+            }
+        });
+    }
+    for (std::thread& t : pool) {
+        t.join();
+    }
+    return 1;
+}
+
+/*****************************************************/
+/*
+client - send each file (or '-' for stdin, as inline source) to a
+server `repeat` times and print the result like a normal run; with
+--repeat > 1 also print round-trip latency percentiles
+*/
+int client(const char* sockPath, const std::vector<const char*>& files, int repeat) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, sockPath, sizeof(addr.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        std::cerr << "ERROR - cannot connect to " << sockPath << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+    Conn in(fd);
+
+    int status = 0;
+    std::vector<double> lat;
+    std::string line, diag;
+    for (const char* f : files) {
+        std::string req;
+        if (strcmp(f, "-") == 0) {
+            std::string src;
+            char buf[65536];
+            size_t n;
+            while ((n = fread(buf, 1, sizeof(buf), stdin)) > 0) {
+                src.append(buf, n);
+            }
+            req = "SRC " + std::to_string(src.size()) + "\n" + src;
+        } else {
+            char full[PATH_MAX];
+            req = std::string("FILE ") + (realpath(f, full) ? full : f) + "\n";
+        }
+
+        bool ok = false;
+        for (int r = 0; r < repeat; r++) {
+            Clock::time_point t0 = Clock::now();
+            if (!writeAll(fd, req.data(), req.size()) || !in.line(line, SERVE_MAX_LINE)) {
+                std::cerr << "ERROR - connection to " << sockPath << " lost\n";
+                return 1;
+            }
+            ok = line == "OK";
+            if (!ok && (line.compare(0, 4, "ERR ") != 0
+                        || !in.bytes(strtoull(line.c_str() + 4, NULL, 10), diag))) {
+                std::cerr << "ERROR - bad reply from " << sockPath << "\n";
+                return 1;
+            }
+            lat.push_back(since(t0));
+        }
+        if (ok) {
+            std::cout << "Parsing completed successfully.\n";
+        } else {
+            std::cerr << diag;
+            status = 1;
+        }
+    }
+    close(fd);
+
+    if (repeat > 1) {
+        std::sort(lat.begin(), lat.end());
+        auto pct = [&](double q) { return lat[(size_t)(q * (lat.size() - 1))] * 1e6; };
+        fprintf(stderr, "requests: %zu  p50: %.1f us  p90: %.1f us  p99: %.1f us  max: %.1f us\n",
+                lat.size(), pct(0.50), pct(0.90), pct(0.99), lat.back() * 1e6);
+    }
+    return status;
+}
@@ -0,0 +1,216 @@
+/*
+  watch.cpp - watch mode (--watch=DIR): re-check the files of a
+  directory as they change, from warm incremental documents.
+*/
+
+#include "../compiler.h"
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <algorithm>
+#include <vector>
+#include <unordered_map>
+#include <dirent.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+/*****************************************************/
+/* Watched - the warm state kept for one file under --watch */
+struct Watched {
+    Document doc;
+    bool     open = false;  // doc holds the file's last contents
+};
+
+/*****************************************************/
+/* watchRead - read a whole file and its modification time */
+static bool watchRead(const std::string& path, std::string& out, struct timespec& mtime) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && (uint64_t)st.st_size <= UINT32_MAX;
+    if (ok) {
+        mtime = st.st_mtim;
+        out.resize((size_t)st.st_size);
+        size_t got = 0;
+        while (got < out.size()) {
+            ssize_t n = read(fd, &out[got], out.size() - got);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            got += (size_t)n;
+        }
+        out.resize(got); // shrank while being read; its next event rereads it
+    }
+    close(fd);
+    return ok;
+}
+
+/*****************************************************/
+/* watchScan - the names of the visible files in dir, sorted */
+static void watchScan(const char* dir, std::vector<std::string>& names) {
+    DIR* d = opendir(dir);
+    if (d == NULL) {
+        return;
+    }
+    while (struct dirent* e = readdir(d)) {
+        if (e->d_name[0] != '.') {
+            names.push_back(e->d_name);
+        }
+    }
+    closedir(d);
+    std::sort(names.begin(), names.end());
+}
+
+/*****************************************************/
+/*
+watchCheck - revalidate one file against its warm state. The change
+is narrowed to the span between the common prefix and suffix of the
+old and new text and applied with docEdit(), so only the statements
+it touches are parsed again; with --eval a valid program is then
+parsed into an AST and run. afterWrite reports the latency from the
+file's modification time to the result.
+*/
+static void watchCheck(const std::string& dir, const std::string& name, Watched& w, bool afterWrite) {
+    static std::string text;
+    struct timespec mtime;
+    std::string path = dir + "/" + name;
+    Clock::time_point t0 = Clock::now();
+    if (!watchRead(path, text, mtime)) {
+        std::cout << "[" << name << "] ERROR - cannot read " << path << "\n" << std::flush;
+        return;
+    }
+    if (w.open && text == w.doc.text) {
+        std::cout << "[" << name << "] unchanged\n" << std::flush;
+        return;
+    }
+
+    if (!w.open) {
+        w.doc.keepAst = evalOn;
+        docOpen(w.doc, path.c_str(), text.data(), text.size());
+        w.open = true;
+    } else {
+        const std::string& old = w.doc.text;
+        size_t m = std::min(old.size(), text.size());
+        size_t pre = 0, suf = 0;
+        while (pre < m && old[pre] == text[pre]) {
+            pre++;
+        }
+        while (suf < m - pre && old[old.size() - 1 - suf] == text[text.size() - 1 - suf]) {
+            suf++;
+        }
+        docEdit(w.doc, pre, old.size() - pre - suf, text.data() + pre, text.size() - pre - suf);
+    }
+    docUpdate(w.doc);
+    if (w.doc.ok && evalOn) {
+        docAst(w.doc);
+    }
+    double took = since(t0);
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    double latency = (double)(now.tv_sec - mtime.tv_sec) + (now.tv_nsec - mtime.tv_nsec) * 1e-9;
+    printf("[%s] %zu statement%s reparsed in %.3f ms", name.c_str(), w.doc.reparsed,
+           w.doc.reparsed == 1 ? "" : "s", took * 1e3);
+    if (afterWrite) {
+        printf(", %.3f ms after write", latency * 1e3);
+    }
+    printf("\n");
+    if (!w.doc.ok) {
+        std::cout << std::flush;
+        std::cerr << w.doc.diag << std::flush;
+        return;
+    }
+    std::cout << "Parsing completed successfully.\n" << std::flush;
+    if (evalOn) {
+        exactOn ? runExact(w.doc.ast) : runProgram(astProgram(w.doc.ast));
+        fflush(stdout);
+    }
+}
+
+/*****************************************************/
+/*
+watch - --watch=DIR: check every file in dir, then revalidate files
+as they are written (closed after writing or renamed into place).
+Events are collected until WATCH_SETTLE_MS pass without one, or at
+most WATCH_MAX_DELAY_MS, so a burst of writes to a file is checked
+once. Each file keeps its Document between checks. Runs until killed.
+*/
+int watch(const char* dir) {
+#ifdef __linux__
+    int fd = inotify_init1(IN_CLOEXEC);
+    if (fd < 0 || inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM) < 0) {
+        std::cerr << "ERROR - cannot watch " << dir << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+    std::unordered_map<std::string, Watched> files;
+    std::vector<std::string> pending;
+    watchScan(dir, pending);
+    bool afterWrite = false;  // the initial check has no write to time from
+    Clock::time_point first = Clock::now();
+    alignas(struct inotify_event) char buf[4096];
+
+    for (;;) {
+        int timeout = -1;
+        if (!pending.empty()) {
+            int waited = (int)(since(first) * 1e3);
+            timeout = waited >= WATCH_MAX_DELAY_MS ? 0 : std::min(WATCH_SETTLE_MS, WATCH_MAX_DELAY_MS - waited);
+        }
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        int ready = timeout == 0 ? 0 : poll(&pfd, 1, timeout);
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ready <= 0) {
+            for (const std::string& name : pending) {
+                struct stat st;
+                if (stat((std::string(dir) + "/" + name).c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+                    watchCheck(dir, name, files[name], afterWrite);
+                } else if (files.erase(name) > 0) {
+                    std::cout << "[" << name << "] removed\n" << std::flush;
+                }
+            }
+            pending.clear();
+            afterWrite = true;
+            continue;
+        }
+
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n <= 0) {
+            continue;
+        }
+        if (pending.empty()) {
+            first = Clock::now();
+        }
+        for (char* p = buf; p < buf + n; ) {
+            const struct inotify_event* ev = (const struct inotify_event*)p;
+            p += sizeof(struct inotify_event) + ev->len;
+            if (ev->mask & IN_Q_OVERFLOW) {
+                watchScan(dir, pending); // events were lost: look at everything
+            } else if (ev->len > 0 && ev->name[0] != '.'
+                       && std::find(pending.begin(), pending.end(), ev->name) == pending.end()) {
+                pending.push_back(ev->name);
+            }
+        }
+        if (pending.size() > 1) {
+            std::sort(pending.begin(), pending.end());
+            pending.erase(std::unique(pending.begin(), pending.end()), pending.end());
+        }
+    }
+#else
+    std::cerr << "ERROR - --watch needs Linux inotify\n";
+    return 1;
+#endif
+}